@@ -0,0 +1,111 @@
+#include "accelerator.h"
+
+#include <sstream>
+
+using namespace std;
+
+namespace
+{
+    char const *const NAMES[] = {"auto", "bvh", "grid", "two level grid"};
+
+    double const GRID_MARGIN = 0.9;     // a grid costs at most this times the BVH
+}
+
+void Accelerator::build(vector<ObjectPtr> const &objects, Structure structure,
+                        double numRays)
+{
+    d_automatic = structure == AUTOMATIC;
+    if (d_automatic)
+    {
+        // only the bounded objects count, the unbounded ones are tested
+        // for every ray by all structures
+        vector<Point> mins;
+        vector<Point> maxs;
+        for (ObjectPtr const &obj : objects)
+        {
+            Point min;
+            Point max;
+            if (obj->bounds(min, max))
+            {
+                mins.push_back(min);
+                maxs.push_back(max);
+            }
+        }
+
+        double buildCost[3];
+        double rayCost[3];
+        BVH::estimate(mins.size(), buildCost[0], rayCost[0]);
+        Grid::estimate(mins, maxs, false, buildCost[1], rayCost[1]);
+        Grid::estimate(mins, maxs, true, buildCost[2], rayCost[2]);
+
+        // the estimates are rough, a grid has to be clearly cheaper
+        structure = TREE;
+        for (unsigned idx = 0; idx != 3; ++idx)
+        {
+            d_costs[idx] = buildCost[idx] + numRays * rayCost[idx];
+            if (idx != 0 && d_costs[idx] < GRID_MARGIN * d_costs[0]
+                && (structure == TREE || d_costs[idx] < d_costs[structure - TREE]))
+                structure = static_cast<Structure>(TREE + idx);
+        }
+    }
+
+    // the other structure is not kept
+    d_structure = structure;
+    d_bvh = BVH();
+    d_grid = Grid();
+    if (structure == TREE)
+        d_bvh.build(objects);
+    else
+        d_grid.build(objects, structure == TWO_LEVEL_GRID);
+}
+
+int Accelerator::intersect(Ray const &ray, Hit &hit) const
+{
+    return d_structure == TREE ? d_bvh.intersect(ray, hit) : d_grid.intersect(ray, hit);
+}
+
+int Accelerator::closest(Ray const &ray, Hit &hit) const
+{
+    return d_structure == TREE ? d_bvh.closest(ray, hit) : d_grid.closest(ray, hit);
+}
+
+string Accelerator::description() const
+{
+    ostringstream out;
+    out << NAMES[d_structure];
+    if (d_structure == TREE)
+        out << " of " << d_bvh.numNodes() << " nodes (" << (d_bvh.bytes() + 1023) / 1024 << " KiB)";
+    else
+    {
+        unsigned res[3];
+        unsigned numFiner;
+        d_grid.resolution(res, numFiner);
+        out << ' ' << res[0] << 'x' << res[1] << 'x' << res[2];
+        if (d_structure == TWO_LEVEL_GRID)
+            out << " with " << numFiner << " finer grids";
+    }
+
+    if (d_automatic)
+    {
+        out << " (auto, estimated cost";
+        for (unsigned idx = 0; idx != 3; ++idx)
+            out << (idx == 0 ? " " : ", ") << NAMES[TREE + idx] << ' ' << d_costs[idx];
+        out << ')';
+    }
+    return out.str();
+}
+
+bool Accelerator::structure(string const &name, Structure &result)
+{
+    if (name == "auto")
+        result = AUTOMATIC;
+    else if (name == "bvh")
+        result = TREE;
+    else if (name == "grid")
+        result = UNIFORM_GRID;
+    else if (name == "twolevelgrid")
+        result = TWO_LEVEL_GRID;
+    else
+        return false;
+    return true;
+}
@@ -0,0 +1,66 @@
+#ifndef ACCELERATOR_H_
+#define ACCELERATOR_H_
+
+#include "bvh.h"
+#include "grid.h"
+#include "object.h"
+
+#include <string>
+#include <vector>
+
+// Forward declerations
+class Hit;
+class Ray;
+
+/**
+ * The acceleration structure over the objects of a scene:
+ *
+ *  bvh          - bounding volume hierarchy, good for any scene
+ *  grid         - uniform grid, cheap to build for many objects of about
+ *                 the same size
+ *  twolevelgrid - coarse grid with finer grids in its full cells, for
+ *                 clustered objects
+ *  auto         - the one with the lowest estimated cost of building it
+ *                 and tracing the rays of the render
+ */
+class Accelerator
+{
+    public:
+
+        enum Structure
+        {
+            AUTOMATIC,
+            TREE,
+            UNIFORM_GRID,
+            TWO_LEVEL_GRID
+        };
+
+    private:
+
+        Structure d_structure = TREE;   // the one built
+        bool d_automatic = false;       // picked by the estimates
+        double d_costs[3];              // estimated costs of TREE, ...
+        BVH d_bvh;
+        Grid d_grid;
+
+    public:
+
+        // builds the structure over the objects, AUTOMATIC picks it for
+        // tracing about numRays rays
+        void build(std::vector<ObjectPtr> const &objects, Structure structure,
+                   double numRays);
+
+        // closest hit, as BVH::intersect
+        int intersect(Ray const &ray, Hit &hit) const;
+
+        // only the distance of the closest hit, as BVH::closest
+        int closest(Ray const &ray, Hit &hit) const;
+
+        // the structure built, its size and the estimates, for the log
+        std::string description() const;
+
+        // the structure called name, false if there is none
+        static bool structure(std::string const &name, Structure &result);
+};
+
+#endif
@@ -0,0 +1,45 @@
+#include "arena.h"
+
+#include <algorithm>
+#include <cstdint>
+
+using namespace std;
+
+namespace
+{
+    size_t const BLOCK_SIZE = 1 << 16;
+}
+
+Arena::~Arena()
+{
+    for (auto it = d_destructors.rbegin(); it != d_destructors.rend(); ++it)
+        it->destroy(it->object);
+}
+
+size_t Arena::bytes() const
+{
+    return d_used;
+}
+
+// --- Private -----------------------------------------------------------------
+
+void *Arena::allocate(size_t size, size_t alignment)
+{
+    size_t padding = (alignment - reinterpret_cast<uintptr_t>(d_next) % alignment) % alignment;
+    if (d_next == nullptr || padding + size > d_left)
+    {
+        // objects larger than a block get a block of their own; new[]
+        // aligns for any fundamental type
+        size_t blockSize = max(size, BLOCK_SIZE);
+        d_blocks.push_back(unique_ptr<char[]>(new char[blockSize]));
+        d_next = d_blocks.back().get();
+        d_left = blockSize;
+        padding = 0;
+    }
+
+    void *memory = d_next + padding;
+    d_next += padding + size;
+    d_left -= padding + size;
+    d_used += size;
+    return memory;
+}
@@ -0,0 +1,78 @@
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Owner of the objects and lights of a scene. They are placed one after
+ * the other in large blocks instead of each in its own heap node, so the
+ * objects a ray is tested against lie close together, and the renderer
+ * refers to them with plain pointers (ObjectPtr, LightPtr) without any
+ * reference counting. Everything is destroyed at once, with the arena.
+ */
+class Arena
+{
+    struct Destructor
+    {
+        void (*destroy)(void *object);
+        void *object;
+    };
+
+    std::vector<std::unique_ptr<char[]>> d_blocks;
+    char *d_next = nullptr;             // free space of the last block
+    size_t d_left = 0;
+    size_t d_used = 0;                  // bytes of all objects
+    std::vector<Destructor> d_destructors;
+
+    public:
+
+        Arena() = default;
+        Arena(Arena const &) = delete;
+        Arena &operator=(Arena const &) = delete;
+
+        // destroys the objects, in the reverse order of creation
+        ~Arena();
+
+        // constructs a Type from args in the arena
+        template <typename Type, typename ...Args>
+        Type *create(Args &&...args);
+
+        size_t bytes() const;
+
+    private:
+
+        void *allocate(size_t size, size_t alignment);
+
+        template <typename Type>
+        static void destroy(void *object);
+};
+
+template <typename Type, typename ...Args>
+Type *Arena::create(Args &&...args)
+{
+    void *memory = allocate(sizeof(Type), alignof(Type));
+
+    // room is made first, so a created object always gets destroyed (the
+    // capacity doubles, reserving one more each time would copy them all)
+    bool destructed = !std::is_trivially_destructible<Type>::value;
+    if (destructed && d_destructors.size() == d_destructors.capacity())
+        d_destructors.reserve(2 * d_destructors.size() + 16);
+
+    Type *object = new (memory) Type(std::forward<Args>(args)...);
+    if (destructed)
+        d_destructors.push_back(Destructor{&destroy<Type>, object});
+    return object;
+}
+
+template <typename Type>
+void Arena::destroy(void *object)
+{
+    static_cast<Type *>(object)->~Type();
+}
+
+#endif
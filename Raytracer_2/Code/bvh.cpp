@@ -0,0 +1,457 @@
+#include "bvh.h"
+
+#include "hit.h"
+#include "ray.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+using namespace std;
+
+namespace
+{
+    unsigned const LEAF_SIZE = 4;       // max objects in a leaf
+    unsigned const STACK_SIZE = 128;    // 3 entries per level of the tree,
+                                        // which is less than 32 deep
+    double const NODE_STEPS = 253;      // across the box of a node, 255 less
+                                        // the two of rounding outwards
+    int const MIN_EXPONENT = -100;      // of the steps, well within float
+    int const MAX_EXPONENT = 100;
+
+    // the child boxes are rounded outwards, and the distances at which a
+    // ray passes them are widened by this much, to make up for the float
+    // rounding in the tests
+    float const SLACK = 1.0f / (1 << 20);
+
+    // costs relative to testing a ray against an object
+    double const NODE_COST = 1.4;       // testing a ray against the
+                                        // children of a node
+    double const BUILD_COST = 1.0;      // an object in a level of the build
+    double const LEAVES_PER_RAY = 2.5;  // leaves tested before the hit
+
+    // 2^exponent
+    float power2(int exponent)
+    {
+        uint32_t bits = static_cast<uint32_t>(exponent + 127) << 23;
+        float result;
+        memcpy(&result, &bits, sizeof(result));
+        return result;
+    }
+
+    // the four children of a node, handled at once (vector extension of
+    // gcc and clang: the loops over the four are not vectorised by
+    // themselves)
+    typedef float Lanes __attribute__((vector_size(4 * sizeof(float))));
+    typedef int32_t IntLanes __attribute__((vector_size(4 * sizeof(int32_t))));
+
+    Lanes lanes(uint8_t const quantised[4])
+    {
+        uint32_t packed;
+        memcpy(&packed, quantised, sizeof(packed));
+        IntLanes shifted = (IntLanes{0, 0, 0, 0} + static_cast<int32_t>(packed))
+                           >> IntLanes{0, 8, 16, 24};
+        return __builtin_convertvector(shifted & 0xff, Lanes);
+    }
+
+    double area(Point const &min, Point const &max)
+    {
+        Vector extent = max - min;
+        return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+    }
+}
+
+struct BVH::Binary
+{
+    Point min;                  // bounding box of the objects in the node
+    Point max;
+    unsigned right;             // index of right child, left is next node
+    unsigned first;             // leaves: range in d_order
+    unsigned count;             // number of objects, 0 for inner nodes
+};
+
+void BVH::build(vector<ObjectPtr> const &objects)
+{
+    d_objects = objects;
+    d_nodes.clear();
+    d_nodes.shrink_to_fit();
+    d_order.clear();
+    d_unbounded.clear();
+
+    vector<Point> mins(objects.size());
+    vector<Point> maxs(objects.size());
+    for (unsigned idx = 0; idx != objects.size(); ++idx)
+    {
+        if (objects[idx]->bounds(mins[idx], maxs[idx]))
+            d_order.push_back(idx);
+        else
+            d_unbounded.push_back(idx);
+    }
+
+    if (d_order.empty())
+        return;
+
+    vector<Binary> tree;
+    tree.reserve(2 * d_order.size() - 1);
+    build(mins, maxs, 0, d_order.size(), tree);
+    d_min = tree[0].min;
+    d_max = tree[0].max;
+
+    // every node takes the place of up to 3 binary ones
+    vector<unsigned> order;
+    order.reserve(d_order.size());
+    d_nodes.reserve(tree.size() / 3 + 1);
+    d_nodes.resize(1);
+    collapse(tree, 0, 0, order);
+    d_order.swap(order);
+}
+
+int BVH::intersect(Ray const &ray, Hit &hit) const
+{
+    int idx = closest(ray, hit);
+    if (idx >= 0)
+        d_objects[idx]->attributes(ray, hit);
+    return idx;
+}
+
+int BVH::closest(Ray const &ray, Hit &hit) const
+{
+    int closest = -1;
+    hit.t = numeric_limits<double>::infinity();
+
+    for (unsigned idx : d_unbounded)
+    {
+        Hit objHit;
+        d_objects[idx]->distance(ray, objHit);
+        if (objHit.t < hit.t && objHit.t > 0)
+        {
+            hit = objHit;
+            closest = idx;
+        }
+    }
+
+    if (d_nodes.empty())
+        return closest;
+
+    float invD[3];
+    for (int axis = 0; axis != 3; ++axis)
+        invD[axis] = static_cast<float>(1.0 / ray.D.data[axis]);
+
+    // the entries on the stack are hit by the ray, at the distances in
+    // stackT. An entry is a node, or the objects of a leaf when its
+    // stackCount is not 0.
+    unsigned stack[STACK_SIZE];
+    unsigned stackCount[STACK_SIZE];
+    double stackT[STACK_SIZE];
+    unsigned size = 0;
+    stack[size] = 0;
+    stackCount[size] = 0;
+    stackT[size++] = 0.0;
+    while (size != 0)
+    {
+        --size;
+        if (stackT[size] > hit.t)
+            continue;                   // a closer hit was found meanwhile
+
+        if (stackCount[size] != 0)
+        {
+            for (unsigned pos = stack[size]; pos != stack[size] + stackCount[size]; ++pos)
+            {
+                unsigned idx = d_order[pos];
+                Hit objHit;
+                d_objects[idx]->distance(ray, objHit);
+                // equal distances: the first object wins, as in a linear search
+                if ((objHit.t < hit.t || (objHit.t == hit.t && static_cast<int>(idx) < closest))
+                    && objHit.t > 0)
+                {
+                    hit = objHit;
+                    closest = idx;
+                }
+            }
+            continue;
+        }
+
+        Node const &node = d_nodes[stack[size]];
+        float tEntry[WIDTH];
+        if (hitsChildren(node, ray, invD, hit.t, tEntry) == 0)
+            continue;
+
+        // the children that are hit, farthest first, so the nearest one
+        // goes on top: its hits mostly rule out the others
+        unsigned item[WIDTH];
+        unsigned count[WIDTH];
+        float itemT[WIDTH];
+        unsigned numItems = 0;
+        unsigned inner = node.firstChild;
+        unsigned object = node.firstObject;
+        for (unsigned child = 0; child != node.numChildren; ++child)
+        {
+            unsigned ref = node.count[child] == 0 ? inner++ : object;
+            object += node.count[child];
+            if (tEntry[child] == numeric_limits<float>::infinity())
+                continue;
+
+            unsigned pos = numItems++;
+            for (; pos != 0 && itemT[pos - 1] < tEntry[child]; --pos)
+            {
+                item[pos] = item[pos - 1];
+                count[pos] = count[pos - 1];
+                itemT[pos] = itemT[pos - 1];
+            }
+            item[pos] = ref;
+            count[pos] = node.count[child];
+            itemT[pos] = tEntry[child];
+        }
+
+        for (unsigned pos = 0; pos != numItems; ++pos)
+        {
+            stack[size] = item[pos];
+            stackCount[size] = count[pos];
+            stackT[size++] = itemT[pos];
+        }
+    }
+    return closest;
+}
+
+ObjectPtr const &BVH::object(unsigned idx) const
+{
+    return d_objects[idx];
+}
+
+size_t BVH::size() const
+{
+    return d_objects.size();
+}
+
+bool BVH::bounds(Point &min, Point &max) const
+{
+    if (d_nodes.empty() || !d_unbounded.empty())
+        return false;
+
+    min = d_min;
+    max = d_max;
+    return true;
+}
+
+size_t BVH::numNodes() const
+{
+    return d_nodes.size();
+}
+
+size_t BVH::bytes() const
+{
+    return d_nodes.size() * sizeof(Node) + d_order.size() * sizeof(unsigned);
+}
+
+void BVH::estimate(size_t count, double &buildCost, double &rayCost)
+{
+    buildCost = 0.0;
+    rayCost = 0.0;
+    if (count == 0)
+        return;
+
+    // the objects are partitioned once per level of the binary tree. A
+    // ray goes down to a few leaves and tests the children of the nodes
+    // on the way, of which there are half as many levels.
+    double depth = max(log2(static_cast<double>(count) / LEAF_SIZE), 0.0) + 1.0;
+    double leaves = min(LEAVES_PER_RAY, ceil(static_cast<double>(count) / LEAF_SIZE));
+    buildCost = BUILD_COST * count * depth;
+    rayCost = NODE_COST * depth / log2(static_cast<double>(WIDTH)) * leaves
+            + min(leaves * LEAF_SIZE, static_cast<double>(count));
+}
+
+// --- Private -----------------------------------------------------------------
+
+// Builds the subtree of the objects d_order[first, last) and returns the
+// index of its root. The objects are split at the median of the centres
+// of their boxes, along the longest axis.
+unsigned BVH::build(vector<Point> const &mins, vector<Point> const &maxs,
+                    unsigned first, unsigned last, vector<Binary> &tree)
+{
+    unsigned nodeIdx = tree.size();
+    tree.push_back(Binary());
+
+    Binary node;
+    node.min = mins[d_order[first]];
+    node.max = maxs[d_order[first]];
+    node.right = 0;
+    node.first = first;
+    node.count = last - first;
+
+    Point centreMin = (mins[d_order[first]] + maxs[d_order[first]]) / 2;
+    Point centreMax = centreMin;
+    for (unsigned pos = first; pos != last; ++pos)
+    {
+        unsigned idx = d_order[pos];
+        Point centre = (mins[idx] + maxs[idx]) / 2;
+        for (int axis = 0; axis != 3; ++axis)
+        {
+            node.min.data[axis] = min(node.min.data[axis], mins[idx].data[axis]);
+            node.max.data[axis] = max(node.max.data[axis], maxs[idx].data[axis]);
+            centreMin.data[axis] = min(centreMin.data[axis], centre.data[axis]);
+            centreMax.data[axis] = max(centreMax.data[axis], centre.data[axis]);
+        }
+    }
+
+    if (last - first > LEAF_SIZE)
+    {
+        Vector extent = centreMax - centreMin;
+        int axis = 0;
+        if (extent.y > extent.data[axis]) axis = 1;
+        if (extent.z > extent.data[axis]) axis = 2;
+
+        unsigned middle = first + (last - first) / 2;
+        nth_element(d_order.begin() + first, d_order.begin() + middle, d_order.begin() + last,
+                    [&](unsigned lhs, unsigned rhs)
+                    {
+                        return mins[lhs].data[axis] + maxs[lhs].data[axis]
+                             < mins[rhs].data[axis] + maxs[rhs].data[axis];
+                    });
+
+        node.count = 0;
+        build(mins, maxs, first, middle, tree);
+        node.right = build(mins, maxs, middle, last, tree);
+    }
+
+    tree[nodeIdx] = node;
+    return nodeIdx;
+}
+
+// Fills d_nodes[nodeIdx] with the children of the binary node: its two
+// children, of which the inner one with the largest box is replaced by
+// its own two children until there are WIDTH. The objects of the leaf
+// children are appended to order, and the inner children are collapsed
+// in turn.
+void BVH::collapse(vector<Binary> const &tree, unsigned binary, unsigned nodeIdx,
+                   vector<unsigned> &order)
+{
+    Binary const &parent = tree[binary];
+    unsigned children[WIDTH];
+    unsigned numChildren = 0;
+    if (parent.count != 0)
+        children[numChildren++] = binary;     // the root is a leaf
+    else
+    {
+        children[numChildren++] = binary + 1;
+        children[numChildren++] = parent.right;
+    }
+
+    while (numChildren != WIDTH)
+    {
+        int largest = -1;
+        double largestArea = -1.0;
+        for (unsigned idx = 0; idx != numChildren; ++idx)
+        {
+            Binary const &child = tree[children[idx]];
+            if (child.count == 0 && area(child.min, child.max) > largestArea)
+            {
+                largest = idx;
+                largestArea = area(child.min, child.max);
+            }
+        }
+        if (largest < 0)
+            break;
+
+        unsigned opened = children[largest];
+        children[largest] = opened + 1;
+        children[numChildren++] = tree[opened].right;
+    }
+
+    // the children are stored in steps of 2^exponent from one step below
+    // the box of the node, and rounded outwards by another step, so the
+    // boxes stay around the objects with the float rounding in hitsChildren
+    Node node;
+    for (int axis = 0; axis != 3; ++axis)
+    {
+        double extent = parent.max.data[axis] - parent.min.data[axis];
+        int exponent = MIN_EXPONENT;
+        if (extent > 0)
+        {
+            exponent = static_cast<int>(ceil(log2(extent / NODE_STEPS)));
+            if (ldexp(NODE_STEPS, exponent) < extent)
+                ++exponent;
+            exponent = max(MIN_EXPONENT, min(MAX_EXPONENT, exponent));
+        }
+        double step = ldexp(1.0, exponent);
+        node.exponent[axis] = exponent;
+        node.origin[axis] = parent.min.data[axis] - step;
+
+        for (unsigned idx = 0; idx != WIDTH; ++idx)
+        {
+            node.lo[axis][idx] = 255;
+            node.hi[axis][idx] = 0;
+            if (idx >= numChildren)
+                continue;
+
+            Binary const &child = tree[children[idx]];
+            double lo = floor((child.min.data[axis] - node.origin[axis]) / step) - 1;
+            double hi = ceil((child.max.data[axis] - node.origin[axis]) / step) + 1;
+            node.lo[axis][idx] = static_cast<uint8_t>(max(lo, 0.0));
+            node.hi[axis][idx] = static_cast<uint8_t>(min(hi, 255.0));
+        }
+    }
+
+    node.numChildren = numChildren;
+    node.firstChild = d_nodes.size();
+    node.firstObject = order.size();
+    unsigned numInner = 0;
+    for (unsigned idx = 0; idx != WIDTH; ++idx)
+    {
+        node.count[idx] = EMPTY;
+        if (idx >= numChildren)
+            continue;
+
+        Binary const &child = tree[children[idx]];
+        node.count[idx] = child.count;
+        if (child.count == 0)
+            ++numInner;
+        for (unsigned pos = child.first; pos != child.first + child.count; ++pos)
+            order.push_back(d_order[pos]);
+    }
+
+    d_nodes[nodeIdx] = node;
+    d_nodes.resize(d_nodes.size() + numInner);
+    unsigned inner = node.firstChild;
+    for (unsigned idx = 0; idx != numChildren; ++idx)
+    {
+        if (tree[children[idx]].count == 0)
+            collapse(tree, children[idx], inner++, order);
+    }
+}
+
+// Slab test of the ray against the boxes of the children, all at once and
+// in float. The sides are taken relative to the ray origin first (in
+// double), so the floats only have to be precise at the scale of the node.
+unsigned BVH::hitsChildren(Node const &node, Ray const &ray, float const invD[3],
+                           double tMax, float tEntry[WIDTH])
+{
+    Lanes tNear = {0.0f, 0.0f, 0.0f, 0.0f};
+    Lanes tFar = tNear + static_cast<float>(tMax);
+    for (int axis = 0; axis != 3; ++axis)
+    {
+        float origin = static_cast<float>(node.origin[axis] - ray.O.data[axis]);
+        float step = power2(node.exponent[axis]);
+        float inv = invD[axis];
+        uint8_t const *entry = inv >= 0 ? node.lo[axis] : node.hi[axis];
+        uint8_t const *exit = inv >= 0 ? node.hi[axis] : node.lo[axis];
+
+        Lanes t1 = (origin + lanes(entry) * step) * inv;
+        Lanes t2 = (origin + lanes(exit) * step) * inv;
+        // written so a NaN (origin on the slab of a parallel ray) keeps
+        // the box
+        tNear = t1 > tNear ? t1 : tNear;
+        tFar = t2 < tFar ? t2 : tFar;
+    }
+
+    tNear *= 1.0f - SLACK;
+    tFar *= 1.0f + SLACK;
+    unsigned numHit = 0;
+    for (unsigned idx = 0; idx != WIDTH; ++idx)
+    {
+        bool hit = node.count[idx] != EMPTY && tNear[idx] <= tFar[idx];
+        tEntry[idx] = hit ? tNear[idx] : numeric_limits<float>::infinity();
+        numHit += hit;
+    }
+    return numHit;
+}
@@ -0,0 +1,141 @@
+#ifndef BVH_H_
+#define BVH_H_
+
+#include "object.h"
+#include "triple.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+// Forward declerations
+class Hit;
+class Ray;
+
+/**
+ * Bounding volume hierarchy over objects, so a ray only has to be tested
+ * against the objects whose bounding boxes it passes through. The Scene
+ * uses one over all its objects and every instanced geometry has its own
+ * (in object space), which makes the two levels of the instancing.
+ * Unbounded objects (planes) are kept apart and tested for every ray.
+ *
+ * The tree is 4 wide: a node holds the boxes of up to four children, so a
+ * ray is tested against the four at once. The boxes are stored in 8 bits
+ * per side, relative to the box of the node (rounded outwards), which
+ * makes a node fit in one cache line. The tree is first built binary and
+ * then collapsed.
+ */
+class BVH
+{
+    enum
+    {
+        WIDTH = 4,
+        EMPTY = 0xff            // Node::count of an unused child
+    };
+
+    struct alignas(64) Node
+    {
+        double origin[3];       // child boxes: origin + q * 2^exponent
+        int8_t exponent[3];
+        uint8_t numChildren;
+        unsigned firstChild;    // the inner children follow each other
+        unsigned firstObject;   // so do the objects of the leaf children,
+                                // in d_order
+        uint8_t count[WIDTH];   // objects of a leaf child, 0 for an inner
+                                // child, EMPTY
+        uint8_t lo[3][WIDTH];   // quantised child boxes, per axis
+        uint8_t hi[3][WIDTH];
+    };
+
+    // keeps the nodes on cache line boundaries, which operator new does
+    // not do before C++17
+    template <typename Type>
+    struct Aligned
+    {
+        typedef Type value_type;
+
+        Aligned() = default;
+        template <typename Other>
+        Aligned(Aligned<Other> const &)
+        {}
+
+        Type *allocate(size_t count)
+        {
+            void *memory;
+            if (posix_memalign(&memory, alignof(Type), count * sizeof(Type)) != 0)
+                throw std::bad_alloc();
+            return static_cast<Type *>(memory);
+        }
+
+        void deallocate(Type *memory, size_t)
+        {
+            free(memory);
+        }
+
+        template <typename Other>
+        bool operator==(Aligned<Other> const &) const
+        {
+            return true;
+        }
+
+        template <typename Other>
+        bool operator!=(Aligned<Other> const &) const
+        {
+            return false;
+        }
+    };
+
+    struct Binary;              // node of the tree before collapsing
+
+    std::vector<ObjectPtr> d_objects;
+    std::vector<Node, Aligned<Node>> d_nodes;
+    std::vector<unsigned> d_order;      // bounded objects in leaf order
+    std::vector<unsigned> d_unbounded;
+    Point d_min;                        // box of the bounded objects
+    Point d_max;
+
+    public:
+
+        void build(std::vector<ObjectPtr> const &objects);
+
+        // closest hit in front of the ray origin. Returns the index of the
+        // object (in the vector given to build) and sets hit, or returns -1
+        // if the ray misses everything.
+        int intersect(Ray const &ray, Hit &hit) const;
+
+        // as intersect, but only the distance (and what the object needs
+        // to find the attributes later) is set: the normal and texture
+        // coordinates are left to Object::attributes, for the closest hit
+        // only
+        int closest(Ray const &ray, Hit &hit) const;
+
+        ObjectPtr const &object(unsigned idx) const;
+        size_t size() const;
+
+        // bounding box of all objects, false if there is an unbounded one
+        bool bounds(Point &min, Point &max) const;
+
+        size_t numNodes() const;
+        size_t bytes() const;           // of the nodes and the leaf order
+
+        // Estimated cost, in ray-object tests, of building a BVH over
+        // count bounded objects and of tracing one ray through it. See
+        // Grid::estimate.
+        static void estimate(size_t count, double &buildCost, double &rayCost);
+
+    private:
+
+        unsigned build(std::vector<Point> const &mins, std::vector<Point> const &maxs,
+                       unsigned first, unsigned last, std::vector<Binary> &tree);
+
+        void collapse(std::vector<Binary> const &tree, unsigned binary, unsigned nodeIdx,
+                      std::vector<unsigned> &order);
+
+        // distances at which the ray enters the children of node, infinity
+        // for the children it misses. Returns the number it hits.
+        static unsigned hitsChildren(Node const &node, Ray const &ray, float const invD[3],
+                                     double tMax, float tEntry[WIDTH]);
+};
+
+#endif
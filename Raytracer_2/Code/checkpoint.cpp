@@ -0,0 +1,157 @@
+#include "checkpoint.h"
+
+#include "image.h"
+#include "mappedfile.h"
+
+#include <cstdio>       // rename, remove
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+
+namespace
+{
+    char const CHECKPOINT_MAGIC[4] = {'R', 'T', 'C', 'P'};
+    uint32_t const CHECKPOINT_VERSION = 1;
+
+    // The checkpoint file consists of this header, followed by a done
+    // byte per pixel and the colors (3 doubles) of all pixels.
+    struct CheckpointHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t key;
+        uint32_t width;
+        uint32_t height;
+    };
+}
+
+Checkpoint::Checkpoint(string const &filename, uint64_t key, unsigned width,
+                       unsigned height, double interval)
+:
+    d_filename(filename),
+    d_key(key),
+    d_width(width),
+    d_height(height),
+    d_interval(interval),
+    d_done(width * height, 0),
+    d_pixels(width * height),
+    d_numDone(0),
+    d_lastWrite(chrono::steady_clock::now())
+{}
+
+bool Checkpoint::load()
+{
+    MappedFile file(d_filename);
+    size_t const numPixels = d_done.size();
+    if (!file.valid() || file.size() != sizeof(CheckpointHeader)
+                                        + numPixels * (1 + 3 * sizeof(double)))
+        return false;
+
+    CheckpointHeader header;
+    memcpy(&header, file.data(), sizeof(CheckpointHeader));
+    if (memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0
+        || header.version != CHECKPOINT_VERSION || header.key != d_key
+        || header.width != d_width || header.height != d_height)
+        return false;
+
+    char const *ptr = file.data() + sizeof(CheckpointHeader);
+    memcpy(d_done.data(), ptr, numPixels);
+    ptr += numPixels;
+
+    d_numDone = 0;
+    for (size_t idx = 0; idx != numPixels; ++idx)
+    {
+        memcpy(d_pixels[idx].data, ptr + idx * 3 * sizeof(double), 3 * sizeof(double));
+        d_numDone += d_done[idx] != 0;
+    }
+    return true;
+}
+
+bool Checkpoint::done(unsigned x, unsigned y) const
+{
+    return d_done[y * d_width + x] != 0;
+}
+
+unsigned long long Checkpoint::numDone() const
+{
+    return d_numDone;
+}
+
+void Checkpoint::restore(Image &img) const
+{
+    for (unsigned y = 0; y != d_height; ++y)
+    {
+        for (unsigned x = 0; x != d_width; ++x)
+        {
+            if (done(x, y))
+                img(x, y) = d_pixels[y * d_width + x];
+        }
+    }
+}
+
+void Checkpoint::complete(Image const &img, vector<Span> const &spans)
+{
+    lock_guard<mutex> lock(d_mutex);
+    for (Span const &span : spans)
+    {
+        for (unsigned x = span.x0; x != span.x1; ++x)
+        {
+            d_pixels[span.y * d_width + x] = img(x, span.y);
+            d_done[span.y * d_width + x] = 1;
+        }
+        d_numDone += span.x1 - span.x0;
+    }
+
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - d_lastWrite;
+    if (elapsed.count() >= d_interval && !writeFile())
+        cerr << "Warning: could not write checkpoint " << d_filename << ".\n";
+}
+
+bool Checkpoint::write()
+{
+    lock_guard<mutex> lock(d_mutex);
+    return writeFile();
+}
+
+void Checkpoint::remove() const
+{
+    ::remove(d_filename.c_str());
+}
+
+// --- Private -----------------------------------------------------------------
+
+bool Checkpoint::writeFile()
+{
+    d_lastWrite = chrono::steady_clock::now();
+
+    CheckpointHeader header {};
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    header.version = CHECKPOINT_VERSION;
+    header.key = d_key;
+    header.width = d_width;
+    header.height = d_height;
+
+    // write to a temporary file first, so a render killed while writing
+    // still leaves the previous checkpoint
+    string const tmpname = d_filename + ".tmp";
+    {
+        ofstream outfile(tmpname, ios::binary | ios::trunc);
+        if (!outfile)
+            return false;
+
+        outfile.write(reinterpret_cast<char const *>(&header), sizeof(CheckpointHeader));
+        outfile.write(reinterpret_cast<char const *>(d_done.data()), d_done.size());
+        for (Color const &pixel : d_pixels)
+            outfile.write(reinterpret_cast<char const *>(pixel.data), 3 * sizeof(double));
+
+        if (!outfile)
+        {
+            outfile.close();
+            ::remove(tmpname.c_str());
+            return false;
+        }
+    }
+    return rename(tmpname.c_str(), d_filename.c_str()) == 0;
+}
@@ -0,0 +1,72 @@
+#ifndef CHECKPOINT_H_
+#define CHECKPOINT_H_
+
+#include "region.h"
+#include "triple.h"
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Forward declerations
+class Image;
+
+/**
+ * Checkpoint of a render in progress: which pixels are done and their
+ * (unrounded) colors. The renderer reports every finished row span or
+ * tile, and the checkpoint is written to disk when the interval since the
+ * last write has passed. A resumed render restores the finished pixels and
+ * only renders the rest; as every pixel sample has its own random seed the
+ * result is identical to an uninterrupted render.
+ *
+ * The key identifies the render (scene, regions, frame size), a checkpoint
+ * with a different key is ignored.
+ */
+class Checkpoint
+{
+    std::string d_filename;
+    uint64_t d_key;
+    unsigned d_width;
+    unsigned d_height;
+    double d_interval;                      // seconds between writes
+
+    std::vector<uint8_t> d_done;            // per pixel
+    std::vector<Color> d_pixels;
+    unsigned long long d_numDone;
+
+    std::mutex d_mutex;
+    std::chrono::steady_clock::time_point d_lastWrite;
+
+    public:
+
+        Checkpoint(std::string const &filename, uint64_t key, unsigned width,
+                   unsigned height, double interval);
+
+        // reads the checkpoint file, false if there is none for this render
+        bool load();
+
+        // true if pixel (x, y) was finished before
+        bool done(unsigned x, unsigned y) const;
+        unsigned long long numDone() const;
+
+        // copies the finished pixels into img
+        void restore(Image &img) const;
+
+        // marks the pixels of the spans done with their colors in img and
+        // writes the checkpoint if it is time to. Thread safe.
+        void complete(Image const &img, std::vector<Span> const &spans);
+
+        // writes the checkpoint file, false on failure
+        bool write();
+
+        // removes the checkpoint file, after the render finished
+        void remove() const;
+
+    private:
+
+        bool writeFile();       // d_mutex must be held
+};
+
+#endif
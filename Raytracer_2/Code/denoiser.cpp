@@ -0,0 +1,183 @@
+#include "denoiser.h"
+
+#include "image.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace
+{
+    // B3 spline, the weights of the taps at -2 ... 2
+    float const KERNEL[5] = {1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16};
+
+    // edge stopping: squared differences are divided by these (squared)
+    // sigmas. The color sigma halves every iteration, the depth sigma is
+    // relative to the depth and grows with the distance between taps.
+    float const SIGMA_COLOR = 0.25f;
+    float const SIGMA_NORMAL = 0.1f;
+    float const SIGMA_DEPTH = 0.0004f;
+    float const SIGMA_ALBEDO = 0.01f;
+
+    // the pixels as separate arrays of floats per channel, so the loops
+    // over a row only do arithmetic on consecutive values
+    struct Planes
+    {
+        vector<float> channel[3];
+
+        explicit Planes(size_t size)
+        {
+            for (vector<float> &plane : channel)
+                plane.assign(size, 0.0f);
+        }
+    };
+}
+
+Features::Features(unsigned width, unsigned height)
+:
+    width(width),
+    height(height),
+    normal(width * height),
+    depth(width * height, 0.0),
+    albedo(width * height),
+    rendered(width * height, 0)
+{}
+
+Denoiser::Denoiser(unsigned iterations)
+:
+    d_iterations(iterations)
+{}
+
+void Denoiser::apply(Image &img, Features const &features) const
+{
+    int const w = img.width();
+    int const h = img.height();
+    size_t const size = w * h;
+
+    Planes color(size);
+    Planes normal(size);
+    Planes albedo(size);
+    vector<float> depth(size);
+    vector<float> mask(size);
+    for (size_t idx = 0; idx != size; ++idx)
+    {
+        Color const &pixel = img(idx % w, idx / w);
+        for (int channel = 0; channel != 3; ++channel)
+        {
+            color.channel[channel][idx] = pixel.data[channel];
+            normal.channel[channel][idx] = features.normal[idx].data[channel];
+            albedo.channel[channel][idx] = features.albedo[idx].data[channel];
+        }
+        depth[idx] = features.depth[idx];
+        mask[idx] = features.rendered[idx];
+    }
+
+    Planes result(size);
+    for (unsigned iteration = 0; iteration != d_iterations; ++iteration)
+    {
+        int const step = 1 << iteration;
+        float const invColor = (1 << (2 * iteration)) / SIGMA_COLOR;
+        float const invNormal = 1.0f / SIGMA_NORMAL;
+        float const invDepth = 1.0f / (SIGMA_DEPTH * step * step);
+        float const invAlbedo = 1.0f / SIGMA_ALBEDO;
+
+        #pragma omp parallel for schedule(static)
+        for (int y = 0; y < h; ++y)
+        {
+            vector<float> sum[3];
+            for (vector<float> &plane : sum)
+                plane.assign(w, 0.0f);
+            vector<float> weights(w, 0.0f);
+            for (int ky = -2; ky <= 2; ++ky)
+            {
+                int const qy = y + ky * step;
+                if (qy < 0 || qy >= h)
+                    continue;
+
+                for (int kx = -2; kx <= 2; ++kx)
+                {
+                    int const shift = kx * step;
+                    float const kernel = KERNEL[ky + 2] * KERNEL[kx + 2];
+                    int const first = max(0, -shift);
+                    int const last = min(w, w - shift);
+
+                    // the pixels of the row and of the taps, as plain
+                    // pointers. The sums never alias the inputs, omp simd
+                    // tells the compiler so.
+                    size_t const p = y * w;
+                    size_t const q = qy * w + shift;
+                    float const *red = color.channel[0].data();
+                    float const *green = color.channel[1].data();
+                    float const *blue = color.channel[2].data();
+                    float const *nx = normal.channel[0].data();
+                    float const *ny = normal.channel[1].data();
+                    float const *nz = normal.channel[2].data();
+                    float const *ar = albedo.channel[0].data();
+                    float const *ag = albedo.channel[1].data();
+                    float const *ab = albedo.channel[2].data();
+                    float const *z = depth.data();
+                    float const *valid = mask.data() + q;
+                    float *sumRed = sum[0].data();
+                    float *sumGreen = sum[1].data();
+                    float *sumBlue = sum[2].data();
+                    float *total = weights.data();
+
+                    #pragma omp simd
+                    for (int x = first; x < last; ++x)
+                    {
+                        float dr = red[p + x] - red[q + x];
+                        float dg = green[p + x] - green[q + x];
+                        float db = blue[p + x] - blue[q + x];
+                        float dnx = nx[p + x] - nx[q + x];
+                        float dny = ny[p + x] - ny[q + x];
+                        float dnz = nz[p + x] - nz[q + x];
+                        float dar = ar[p + x] - ar[q + x];
+                        float dag = ag[p + x] - ag[q + x];
+                        float dab = ab[p + x] - ab[q + x];
+                        float dd = z[p + x] - z[q + x];
+                        float distance = (dr * dr + dg * dg + db * db) * invColor
+                                       + (dnx * dnx + dny * dny + dnz * dnz) * invNormal
+                                       + dd * dd / (z[p + x] * z[p + x] + 1e-6f) * invDepth
+                                       + (dar * dar + dag * dag + dab * dab) * invAlbedo;
+
+                        // max(0, 1 - d / 4)^4 instead of exp(-d): about the
+                        // same falloff, but it vectorizes (without branches)
+                        float falloff = 1.0f - 0.25f * distance;
+                        falloff = 0.5f * (falloff + fabsf(falloff));
+                        falloff *= falloff;
+                        falloff *= falloff;
+
+                        float weight = kernel * falloff * valid[x];
+                        sumRed[x] += weight * red[q + x];
+                        sumGreen[x] += weight * green[q + x];
+                        sumBlue[x] += weight * blue[q + x];
+                        total[x] += weight;
+                    }
+                }
+            }
+
+            // the centre tap always counts, weights is never 0 for a
+            // rendered pixel
+            for (int x = 0; x < w; ++x)
+            {
+                int const p = y * w + x;
+                for (int channel = 0; channel != 3; ++channel)
+                {
+                    result.channel[channel][p] = mask[p] != 0.0f
+                        ? sum[channel][x] / weights[x] : color.channel[channel][p];
+                }
+            }
+        }
+
+        for (int channel = 0; channel != 3; ++channel)
+            color.channel[channel].swap(result.channel[channel]);
+    }
+
+    for (size_t idx = 0; idx != size; ++idx)
+    {
+        if (mask[idx] != 0.0f)
+            img(idx % w, idx / w) = Color(color.channel[0][idx], color.channel[1][idx],
+                                          color.channel[2][idx]);
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef DENOISER_H_
+#define DENOISER_H_
+
+#include "triple.h"
+
+#include <vector>
+
+// Forward declerations
+class Image;
+
+// What the camera rays hit first, averaged over the samples of a pixel.
+// Rendered by Scene::renderFeatures, guides the Denoiser.
+struct Features
+{
+    unsigned width;
+    unsigned height;
+    std::vector<Vector> normal;
+    std::vector<double> depth;              // distance along the ray, 0: miss
+    std::vector<Color> albedo;              // surface color without light
+    std::vector<unsigned char> rendered;    // 1 for the pixels of the regions
+
+    Features(unsigned width, unsigned height);
+};
+
+/**
+ * Edge-aware a-trous wavelet filter (Dammertz et al., "Edge-Avoiding
+ * A-Trous Wavelet Transform for fast Global Illumination Filtering").
+ * Every iteration blurs the image with a 5x5 B3 spline kernel whose taps
+ * are twice as far apart as in the previous one, so five iterations
+ * cover 125 x 125 pixels with 25 taps each. A tap only counts as far as
+ * its color, normal, depth and albedo are close to those of the centre
+ * pixel, so edges between objects, shadow borders and texture details
+ * are kept while noise within a surface is smoothed out.
+ *
+ * Meant for low sample previews ("Denoise": true in the scene file).
+ */
+class Denoiser
+{
+    unsigned d_iterations;
+
+    public:
+
+        explicit Denoiser(unsigned iterations = 5);
+
+        // denoises the rendered pixels of img, the others are left alone
+        void apply(Image &img, Features const &features) const;
+};
+
+#endif
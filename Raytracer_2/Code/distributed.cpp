@@ -0,0 +1,370 @@
+#include "distributed.h"
+
+#include "image.h"
+#include "scene.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <list>
+#include <stdexcept>
+#include <thread>
+
+#include <poll.h>
+
+using namespace std;
+
+namespace
+{
+    char const PROTOCOL_MAGIC[4] = {'R', 'T', 'D', 'R'};
+    uint32_t const PROTOCOL_VERSION = 1;
+
+    // a multiple of the wavefront tile size, so the wavefront renderer
+    // groups the same rays as in a local render
+    unsigned const TILE_SIZE = 64;
+
+    // tiles sent to a worker before it returns the first, hides the
+    // network latency
+    unsigned const TILES_IN_FLIGHT = 2;
+
+    enum MessageType : uint32_t
+    {
+        MSG_HELLO,      // worker -> coordinator: Hello
+        MSG_TILE,       // coordinator -> worker: id, tile, regions in it
+        MSG_RESULT,     // worker -> coordinator: id, colors of the tile
+        MSG_DONE,       // coordinator -> worker: no more tiles
+        MSG_REJECT      // coordinator -> worker: different scene or version
+    };
+
+    struct MessageHeader
+    {
+        uint32_t type;
+        uint32_t size;              // of the payload that follows
+    };
+
+    struct Hello
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t sceneHash;
+        uint32_t width;
+        uint32_t height;
+    };
+
+    struct Tile
+    {
+        Region bounds;
+        vector<Region> regions;     // the parts of the frame regions in it
+    };
+
+    bool sendMessage(Socket &sock, uint32_t type, vector<char> const &payload)
+    {
+        MessageHeader header {type, static_cast<uint32_t>(payload.size())};
+        return sock.sendAll(&header, sizeof(header))
+            && (payload.empty() || sock.sendAll(payload.data(), payload.size()));
+    }
+
+    bool receiveMessage(Socket &sock, uint32_t &type, vector<char> &payload)
+    {
+        MessageHeader header;
+        if (!sock.receiveAll(&header, sizeof(header)))
+            return false;
+
+        type = header.type;
+        payload.resize(header.size);
+        return payload.empty() || sock.receiveAll(payload.data(), payload.size());
+    }
+
+    template <typename Value>
+    void append(vector<char> &payload, Value const &value)
+    {
+        char const *bytes = reinterpret_cast<char const *>(&value);
+        payload.insert(payload.end(), bytes, bytes + sizeof(Value));
+    }
+
+    // the frame cut into tiles, with the parts of the regions in each tile
+    vector<Tile> makeTiles(unsigned width, unsigned height, vector<Region> const &regions)
+    {
+        vector<Tile> tiles;
+        for (unsigned y0 = 0; y0 < height; y0 += TILE_SIZE)
+        {
+            for (unsigned x0 = 0; x0 < width; x0 += TILE_SIZE)
+            {
+                unsigned x1 = min(x0 + TILE_SIZE, width);
+                unsigned y1 = min(y0 + TILE_SIZE, height);
+
+                Tile tile {Region{x0, y0, x1 - x0, y1 - y0}, {}};
+                for (Region const &region : regions)
+                {
+                    unsigned rx0 = max(x0, region.x);
+                    unsigned ry0 = max(y0, region.y);
+                    unsigned rx1 = min(x1, region.x + region.width);
+                    unsigned ry1 = min(y1, region.y + region.height);
+                    if (rx0 < rx1 && ry0 < ry1)
+                        tile.regions.push_back(Region{rx0, ry0, rx1 - rx0, ry1 - ry0});
+                }
+                if (!tile.regions.empty())
+                    tiles.push_back(tile);
+            }
+        }
+        return tiles;
+    }
+
+    struct Connection
+    {
+        Socket sock;
+        bool greeted;
+        deque<uint32_t> tiles;      // sent, but not returned yet
+        unsigned numRendered;
+    };
+}
+
+Coordinator::Coordinator(string const &address)
+:
+    d_listener(Socket::listen(address))
+{
+    cout << "Coordinator listening on " << address << ".\n";
+}
+
+void Coordinator::render(Image &img, vector<Region> const &regions, uint64_t sceneHash)
+{
+    vector<Tile> const tiles = makeTiles(img.width(), img.height(), regions);
+    deque<uint32_t> pending;
+    for (uint32_t id = 0; id != tiles.size(); ++id)
+        pending.push_back(id);
+    vector<bool> done(tiles.size(), false);
+    size_t numDone = 0;
+
+    list<Connection> workers;
+    unsigned numWorkers = 0;
+
+    // hands out tiles to the worker until it has TILES_IN_FLIGHT of them
+    auto feed = [&](Connection &worker)
+    {
+        while (worker.tiles.size() < TILES_IN_FLIGHT && !pending.empty())
+        {
+            uint32_t id = pending.front();
+            vector<char> payload;
+            append(payload, id);
+            append(payload, tiles[id].bounds);
+            for (Region const &region : tiles[id].regions)
+                append(payload, region);
+            if (!sendMessage(worker.sock, MSG_TILE, payload))
+                return false;
+
+            pending.pop_front();
+            worker.tiles.push_back(id);
+        }
+        return true;
+    };
+
+    // reads a message of the worker, false if the worker is lost
+    auto handle = [&](Connection &worker)
+    {
+        uint32_t type;
+        vector<char> payload;
+        if (!receiveMessage(worker.sock, type, payload))
+            return false;
+
+        if (type == MSG_HELLO && !worker.greeted)
+        {
+            Hello hello;
+            if (payload.size() != sizeof(Hello))
+                return false;
+            memcpy(&hello, payload.data(), sizeof(Hello));
+            if (memcmp(hello.magic, PROTOCOL_MAGIC, sizeof(PROTOCOL_MAGIC)) != 0
+                || hello.version != PROTOCOL_VERSION || hello.sceneHash != sceneHash
+                || hello.width != img.width() || hello.height != img.height())
+            {
+                cerr << "Warning: worker with a different scene or version rejected.\n";
+                sendMessage(worker.sock, MSG_REJECT, {});
+                return false;
+            }
+            worker.greeted = true;
+            ++numWorkers;
+            return feed(worker);
+        }
+
+        if (type != MSG_RESULT || !worker.greeted || payload.size() < sizeof(uint32_t))
+            return false;
+
+        uint32_t id;
+        memcpy(&id, payload.data(), sizeof(id));
+        auto pos = find(worker.tiles.begin(), worker.tiles.end(), id);
+        if (pos == worker.tiles.end())
+            return false;
+
+        Region const &bounds = tiles[id].bounds;
+        if (payload.size() != sizeof(id) + bounds.width * bounds.height * 3 * sizeof(double))
+            return false;
+
+        // only the pixels of the regions, the rest of img stays as it is
+        double const *colors = reinterpret_cast<double const *>(payload.data() + sizeof(id));
+        for (Region const &region : tiles[id].regions)
+        {
+            for (unsigned y = region.y; y != region.y + region.height; ++y)
+            {
+                for (unsigned x = region.x; x != region.x + region.width; ++x)
+                {
+                    double const *color = colors
+                        + 3 * ((y - bounds.y) * bounds.width + (x - bounds.x));
+                    img(x, y) = Color(color[0], color[1], color[2]);
+                }
+            }
+        }
+
+        worker.tiles.erase(pos);
+        ++worker.numRendered;
+        if (!done[id])
+        {
+            done[id] = true;
+            ++numDone;
+        }
+        return feed(worker);
+    };
+
+    while (numDone != tiles.size())
+    {
+        vector<pollfd> fds;
+        fds.push_back(pollfd{d_listener.fd(), POLLIN, 0});
+        for (Connection const &worker : workers)
+            fds.push_back(pollfd{worker.sock.fd(), POLLIN, 0});
+
+        if (poll(fds.data(), fds.size(), -1) < 0)
+            continue;           // interrupted
+
+        size_t idx = 1;
+        for (auto worker = workers.begin(); worker != workers.end(); ++idx)
+        {
+            if ((fds[idx].revents & (POLLIN | POLLHUP | POLLERR)) == 0 || handle(*worker))
+            {
+                ++worker;
+                continue;
+            }
+
+            // lost the worker: its tiles go back to the front of the queue
+            if (worker->greeted)
+                cerr << "Warning: lost a worker, " << worker->tiles.size()
+                     << " tiles are handed out again.\n";
+            for (auto id = worker->tiles.rbegin(); id != worker->tiles.rend(); ++id)
+            {
+                if (!done[*id])
+                    pending.push_front(*id);
+            }
+            if (worker->greeted)
+                --numWorkers;
+            worker = workers.erase(worker);
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            Socket sock = d_listener.accept();
+            if (sock.valid())
+                workers.push_back(Connection{move(sock), false, {}, 0});
+        }
+
+        // workers idle because the queue was empty get the returned tiles
+        for (auto worker = workers.begin(); worker != workers.end(); )
+        {
+            if (!worker->greeted || feed(*worker))
+                ++worker;
+            else
+            {
+                for (uint32_t id : worker->tiles)
+                    pending.push_front(id);
+                if (worker->greeted)
+                    --numWorkers;
+                worker = workers.erase(worker);
+            }
+        }
+    }
+
+    unsigned idx = 0;
+    for (Connection &worker : workers)
+    {
+        sendMessage(worker.sock, MSG_DONE, {});
+        if (worker.greeted)
+            cout << "Worker " << idx++ << ": " << worker.numRendered << " tiles.\n";
+    }
+    cout << "Rendered " << tiles.size() << " tiles with " << numWorkers << " workers.\n";
+}
+
+unsigned Worker::run(string const &address, Scene &scene, uint64_t sceneHash,
+                     unsigned width, unsigned height)
+{
+    // the coordinator may not be up yet, keep trying for a while
+    Socket sock;
+    for (unsigned attempt = 0; !sock.valid(); ++attempt)
+    {
+        try
+        {
+            sock = Socket::connect(address);
+        }
+        catch (runtime_error const &)
+        {
+            if (attempt == 100)
+                throw;
+            this_thread::sleep_for(chrono::milliseconds(100));
+        }
+    }
+
+    Hello hello {};
+    memcpy(hello.magic, PROTOCOL_MAGIC, sizeof(PROTOCOL_MAGIC));
+    hello.version = PROTOCOL_VERSION;
+    hello.sceneHash = sceneHash;
+    hello.width = width;
+    hello.height = height;
+
+    vector<char> payload;
+    append(payload, hello);
+    if (!sendMessage(sock, MSG_HELLO, payload))
+        throw runtime_error("Lost the connection to the coordinator");
+
+    Image img(width, height);
+    unsigned numTiles = 0;
+    uint32_t type;
+    while (receiveMessage(sock, type, payload))
+    {
+        if (type == MSG_DONE)
+            return numTiles;
+        if (type == MSG_REJECT)
+            throw runtime_error("The coordinator renders a different scene");
+
+        if (type != MSG_TILE || payload.size() < sizeof(uint32_t) + sizeof(Region)
+            || (payload.size() - sizeof(uint32_t)) % sizeof(Region) != 0)
+            throw runtime_error("Unexpected message from the coordinator");
+
+        uint32_t id;
+        Region bounds;
+        memcpy(&id, payload.data(), sizeof(id));
+        memcpy(&bounds, payload.data() + sizeof(id), sizeof(Region));
+        vector<Region> regions((payload.size() - sizeof(id)) / sizeof(Region) - 1);
+        memcpy(regions.data(), payload.data() + sizeof(id) + sizeof(Region),
+               regions.size() * sizeof(Region));
+
+        if (bounds.x + bounds.width > width || bounds.y + bounds.height > height)
+            throw runtime_error("Tile outside of the frame");
+
+        scene.render(img, regions);
+
+        vector<char> result;
+        result.reserve(sizeof(id) + bounds.width * bounds.height * 3 * sizeof(double));
+        append(result, id);
+        for (unsigned y = bounds.y; y != bounds.y + bounds.height; ++y)
+        {
+            for (unsigned x = bounds.x; x != bounds.x + bounds.width; ++x)
+            {
+                Color const &color = img(x, y);
+                append(result, color.r);
+                append(result, color.g);
+                append(result, color.b);
+            }
+        }
+        if (!sendMessage(sock, MSG_RESULT, result))
+            break;
+        ++numTiles;
+    }
+    throw runtime_error("Lost the connection to the coordinator");
+}
@@ -0,0 +1,51 @@
+#ifndef DISTRIBUTED_H_
+#define DISTRIBUTED_H_
+
+#include "region.h"
+#include "socket.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Forward declerations
+class Image;
+class Scene;
+
+/**
+ * Distributed rendering. The coordinator splits the frame into tiles and
+ * hands them out to worker processes (`ray --worker`), which load the
+ * scene once and render tile after tile until the coordinator is done.
+ * Workers may connect (and disconnect) at any time, the tiles of a lost
+ * worker are handed out again. Every tile is rendered exactly as a local
+ * render would, so the image is the same.
+ *
+ * Both sides must run on the same kind of machine: pixels are sent as
+ * raw doubles.
+ */
+class Coordinator
+{
+    Socket d_listener;
+
+    public:
+
+        // listens on address, see Socket for the format
+        explicit Coordinator(std::string const &address);
+
+        // renders the regions of img with the workers. The workers must
+        // have loaded the scene file with hash sceneHash.
+        void render(Image &img, std::vector<Region> const &regions, uint64_t sceneHash);
+};
+
+class Worker
+{
+    public:
+
+        // connects to the coordinator at address and renders the tiles it
+        // sends, returns the number of tiles rendered. Throws runtime_error
+        // when the coordinator can not be reached or rejects the scene.
+        static unsigned run(std::string const &address, Scene &scene, uint64_t sceneHash,
+                            unsigned width, unsigned height);
+};
+
+#endif
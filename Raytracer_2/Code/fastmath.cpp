@@ -0,0 +1,8 @@
+#include "fastmath.h"
+
+void FastMath::pow(float const *x, float const *y, float *out, unsigned count)
+{
+    #pragma omp simd
+    for (unsigned idx = 0; idx < count; ++idx)
+        out[idx] = pow(x[idx], y[idx]);
+}
@@ -0,0 +1,59 @@
+#include "filestamp.h"
+
+#include <fstream>
+
+#include <sys/stat.h>
+
+using namespace std;
+
+namespace
+{
+    bool fileStat(string const &filename, uint64_t &size, int64_t &time)
+    {
+        struct stat st;
+        if (stat(filename.c_str(), &st) != 0)
+            return false;
+
+        size = st.st_size;
+        time = st.st_mtime;
+        return true;
+    }
+
+    bool fileHash(string const &filename, uint64_t &hash)
+    {
+        ifstream infile(filename, ios::binary);
+        if (!infile)
+            return false;
+
+        hash = 14695981039346656037ULL;     // FNV-1a offset basis
+        char buffer[1 << 16];
+        while (infile.read(buffer, sizeof(buffer)) || infile.gcount() > 0)
+        {
+            for (streamsize idx = 0; idx != infile.gcount(); ++idx)
+            {
+                hash ^= static_cast<unsigned char>(buffer[idx]);
+                hash *= 1099511628211ULL;   // FNV-1a prime
+            }
+        }
+        return true;
+    }
+}
+
+bool FileStamp::read(string const &filename)
+{
+    return fileStat(filename, size, time) && fileHash(filename, hash);
+}
+
+bool FileStamp::matches(string const &filename) const
+{
+    uint64_t currentSize;
+    int64_t currentTime;
+    if (!fileStat(filename, currentSize, currentTime) || currentSize != size)
+        return false;
+
+    if (currentTime == time)
+        return true;
+
+    uint64_t currentHash;
+    return fileHash(filename, currentHash) && currentHash == hash;
+}
@@ -0,0 +1,28 @@
+#ifndef FILESTAMP_H_
+#define FILESTAMP_H_
+
+#include <cstdint>
+#include <string>
+
+/**
+ * Identifies the contents of a source file a cache was created from: its
+ * size, modification time and FNV-1a hash. POD, so it can be stored in
+ * the header of a cache file as is.
+ */
+class FileStamp
+{
+    public:
+        uint64_t size;
+        int64_t time;
+        uint64_t hash;
+
+        // stamp the current contents of the file, false if it can't be read
+        bool read(std::string const &filename);
+
+        // true if the file still has the stamped contents. An unchanged
+        // size and modification time are trusted, else the file may just
+        // have been touched or copied so its hash is compared.
+        bool matches(std::string const &filename) const;
+};
+
+#endif
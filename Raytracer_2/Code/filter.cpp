@@ -0,0 +1,213 @@
+#include "filter.h"
+
+#include "image.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace
+{
+    unsigned const STEPS = 64;          // Simpson steps per pixel
+
+    double const GAUSSIAN_ALPHA = 2.0;  // falloff of the gaussian
+    double const MITCHELL_B = 1.0 / 3;
+    double const MITCHELL_C = 1.0 / 3;
+
+    // Mitchell-Netravali cubic for |x| in [0, 2]
+    double mitchell(double x)
+    {
+        x = fabs(x);
+        double const B = MITCHELL_B;
+        double const C = MITCHELL_C;
+        if (x < 1)
+            return ((12 - 9 * B - 6 * C) * x * x * x + (-18 + 12 * B + 6 * C) * x * x
+                    + (6 - 2 * B)) / 6;
+        if (x < 2)
+            return ((-B - 6 * C) * x * x * x + (6 * B + 30 * C) * x * x
+                    + (-12 * B - 48 * C) * x + (8 * B + 24 * C)) / 6;
+        return 0;
+    }
+}
+
+Filter::Filter(Type type, double radius)
+:
+    d_type(type),
+    d_radius(radius)
+{
+    if (d_radius <= 0)
+    {
+        static double const defaultRadius[] = {0.5, 1.0, 1.5, 2.0};
+        d_radius = defaultRadius[d_type];
+    }
+
+    if (d_type == BOX)
+    {
+        d_weights.push_back(1.0);
+        return;
+    }
+
+    // the pixel at offset k covers [k - 1/2, k + 1/2], integrate the filter
+    // over it with Simpson's rule
+    int margin = static_cast<int>(ceil(d_radius + 0.5)) - 1;
+    double sum = 0;
+    for (int k = -margin; k <= margin; ++k)
+    {
+        double h = 1.0 / STEPS;
+        double weight = evaluate(k - 0.5) + evaluate(k + 0.5);
+        for (unsigned step = 1; step != STEPS; ++step)
+            weight += (step % 2 ? 4 : 2) * evaluate(k - 0.5 + step * h);
+        weight *= h / 3;
+        d_weights.push_back(weight);
+        sum += weight;
+    }
+    for (double &weight : d_weights)
+        weight /= sum;
+}
+
+unsigned Filter::margin() const
+{
+    return d_weights.size() / 2;
+}
+
+void Filter::apply(Image &img) const
+{
+    if (d_type == BOX)
+        return;
+
+    // the pixels as rows of r, g, b doubles, so both passes run over
+    // contiguous memory
+    unsigned w = img.width();
+    unsigned h = img.height();
+    vector<double> data(3 * w * h);
+    for (unsigned y = 0; y != h; ++y)
+    {
+        for (unsigned x = 0; x != w; ++x)
+        {
+            Color const &color = img(x, y);
+            double *pixel = &data[3 * (y * w + x)];
+            pixel[0] = color.r;
+            pixel[1] = color.g;
+            pixel[2] = color.b;
+        }
+    }
+
+    filterRows(data, w, h);
+    filterColumns(data, w, h);
+
+    for (unsigned y = 0; y != h; ++y)
+    {
+        for (unsigned x = 0; x != w; ++x)
+        {
+            // the negative lobes of Mitchell can give negative values,
+            // clamp only limits from above
+            double const *pixel = &data[3 * (y * w + x)];
+            Color color(max(pixel[0], 0.0), max(pixel[1], 0.0), max(pixel[2], 0.0));
+            color.clamp();
+            img(x, y) = color;
+        }
+    }
+}
+
+bool Filter::type(string const &name, Type &result)
+{
+    if (name == "box")
+        result = BOX;
+    else if (name == "tent")
+        result = TENT;
+    else if (name == "gaussian")
+        result = GAUSSIAN;
+    else if (name == "mitchell")
+        result = MITCHELL;
+    else
+        return false;
+    return true;
+}
+
+// --- Private -----------------------------------------------------------------
+
+double Filter::evaluate(double x) const
+{
+    x = fabs(x);
+    if (x >= d_radius)
+        return 0;
+
+    switch (d_type)
+    {
+        case TENT:
+            return d_radius - x;
+        case GAUSSIAN:
+            return exp(-GAUSSIAN_ALPHA * x * x) - exp(-GAUSSIAN_ALPHA * d_radius * d_radius);
+        case MITCHELL:
+            return mitchell(2 * x / d_radius);
+        default:
+            return 1;
+    }
+}
+
+void Filter::filterRows(vector<double> &data, unsigned width, unsigned height) const
+{
+    int margin = this->margin();
+    int w = width;
+
+    // near the borders the weights of the pixels inside add up to less
+    // than one
+    vector<double> norm(w, 0.0);
+    for (int k = -margin; k <= margin; ++k)
+    {
+        for (int x = max(0, -k); x < min(w, w - k); ++x)
+            norm[x] += d_weights[k + margin];
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < static_cast<int>(height); ++y)
+    {
+        double *row = &data[3 * y * w];
+        vector<double> result(3 * w, 0.0);
+
+        // the row shifted by k pixels, times its weight: plain loops over
+        // arrays the compiler vectorizes
+        for (int k = -margin; k <= margin; ++k)
+        {
+            double weight = d_weights[k + margin];
+            int first = 3 * max(0, -k);
+            int last = 3 * min(w, w - k);
+            for (int idx = first; idx < last; ++idx)
+                result[idx] += weight * row[idx + 3 * k];
+        }
+
+        for (int x = 0; x < w; ++x)
+        {
+            for (int channel = 0; channel != 3; ++channel)
+                row[3 * x + channel] = result[3 * x + channel] / norm[x];
+        }
+    }
+}
+
+void Filter::filterColumns(vector<double> &data, unsigned width, unsigned height) const
+{
+    int margin = this->margin();
+    int h = height;
+    int stride = 3 * width;
+    vector<double> result(data.size(), 0.0);
+
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < h; ++y)
+    {
+        // weighted sum of whole rows
+        double *out = &result[y * stride];
+        double norm = 0;
+        for (int k = max(-margin, -y); k <= min(margin, h - 1 - y); ++k)
+        {
+            double weight = d_weights[k + margin];
+            double const *row = &data[(y + k) * stride];
+            for (int idx = 0; idx < stride; ++idx)
+                out[idx] += weight * row[idx];
+            norm += weight;
+        }
+        for (int idx = 0; idx < stride; ++idx)
+            out[idx] /= norm;
+    }
+    data.swap(result);
+}
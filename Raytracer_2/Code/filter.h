@@ -0,0 +1,66 @@
+#ifndef FILTER_H_
+#define FILTER_H_
+
+#include <string>
+#include <vector>
+
+// Forward declerations
+class Image;
+
+/**
+ * Pixel reconstruction filter. The renderers average the samples of a
+ * pixel (a box filter); the other filters also let the samples count for
+ * the neighbouring pixels, weighted by the distance to their centres:
+ *
+ *  box      - nothing to do, the default
+ *  tent     - linear falloff, radius 1 (slightly soft)
+ *  gaussian - radius 1.5
+ *  mitchell - Mitchell-Netravali (B = C = 1/3), radius 2 (sharp)
+ *
+ * Every filter is separable, so it is applied to the averaged pixels as
+ * a pass over the rows and a pass over the columns. A pixel averages the
+ * samples over its area, so its weight for a neighbour at distance k is
+ * the filter integrated over [k - 1/2, k + 1/2].
+ */
+class Filter
+{
+    public:
+
+        enum Type
+        {
+            BOX,
+            TENT,
+            GAUSSIAN,
+            MITCHELL
+        };
+
+    private:
+
+        Type d_type;
+        double d_radius;
+        std::vector<double> d_weights;  // for offsets -margin ... margin
+
+    public:
+
+        // radius 0: the default radius of the type
+        explicit Filter(Type type = BOX, double radius = 0);
+
+        // number of neighbouring pixels on each side that add to a pixel
+        unsigned margin() const;
+
+        // filters the image, pixels near the borders only use the pixels
+        // inside. The result is clamped to [0, 1].
+        void apply(Image &img) const;
+
+        // the filter type called name, false if there is none
+        static bool type(std::string const &name, Type &result);
+
+    private:
+
+        double evaluate(double x) const;
+
+        void filterRows(std::vector<double> &data, unsigned width, unsigned height) const;
+        void filterColumns(std::vector<double> &data, unsigned width, unsigned height) const;
+};
+
+#endif
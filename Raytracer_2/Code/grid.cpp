@@ -0,0 +1,458 @@
+#include "grid.h"
+
+#include "hit.h"
+#include "ray.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+
+namespace
+{
+    double const DENSITY = 2.0;         // cells per object (uniform, finer grids)
+    double const TOP_DENSITY = 1.0 / 8; // cells per object of the top grid
+    unsigned const FULL_CELL = 8;       // more objects: the cell gets a finer grid
+    unsigned const MAX_RES = 256;       // cells along an axis, at most
+    unsigned const MAILBOX = 16;        // objects tested last, not tested again
+
+    // costs relative to testing a ray against an object
+    double const STEP_COST = 0.5;       // a ray going to the next cell
+    double const ENTER_COST = 2.0;      // a ray entering a grid
+    double const CELL_BUILD_COST = 0.3; // setting up a cell
+    double const REF_BUILD_COST = 1.0;  // counting and storing an object of a cell
+    double const HIT_CELLS = 4.0;       // non-empty cells visited before the hit
+    unsigned const MAX_SAMPLES = 1 << 14;   // objects the estimate looks at
+
+    unsigned cellIndex(double pos, unsigned res)
+    {
+        // written so a NaN ends up in the first cell
+        if (!(pos > 0))
+            return 0;
+        return pos < res ? static_cast<unsigned>(pos) : res - 1;
+    }
+}
+
+void Grid::build(vector<ObjectPtr> const &objects, bool twoLevel)
+{
+    d_objects = objects;
+    d_levels.clear();
+    d_cells.clear();
+    d_refs.clear();
+    d_unbounded.clear();
+
+    vector<Point> mins(objects.size());
+    vector<Point> maxs(objects.size());
+    vector<unsigned> bounded;
+    for (unsigned idx = 0; idx != objects.size(); ++idx)
+    {
+        if (objects[idx]->bounds(mins[idx], maxs[idx]))
+            bounded.push_back(idx);
+        else
+            d_unbounded.push_back(idx);
+    }
+
+    if (bounded.empty())
+        return;
+
+    Point min;
+    Point max;
+    box(mins, maxs, bounded, min, max);
+
+    unsigned res[3];
+    chooseResolution(min, max, bounded.size(), twoLevel ? TOP_DENSITY : DENSITY, res);
+    addLevel(min, max, res, bounded, mins, maxs);
+    if (!twoLevel)
+        return;
+
+    // the objects of a full cell stay in d_refs, only the cell is pointed
+    // to the finer grid over its box
+    Level const top = d_levels[0];
+    vector<unsigned> cellObjects;
+    unsigned numCells = top.res[0] * top.res[1] * top.res[2];
+    for (unsigned idx = 0; idx != numCells; ++idx)
+    {
+        Cell const cell = d_cells[top.firstCell + idx];
+        if (cell.count <= FULL_CELL)
+            continue;
+
+        unsigned x = idx % top.res[0];
+        unsigned y = idx / top.res[0] % top.res[1];
+        unsigned z = idx / top.res[0] / top.res[1];
+        Point cellMin = top.min + Vector(x * top.cellSize.x, y * top.cellSize.y,
+                                         z * top.cellSize.z);
+        Point cellMax = cellMin + top.cellSize;
+        unsigned fineRes[3];
+        chooseResolution(cellMin, cellMax, cell.count, DENSITY, fineRes);
+
+        cellObjects.assign(d_refs.begin() + cell.first,
+                           d_refs.begin() + cell.first + cell.count);
+        unsigned level = addLevel(cellMin, cellMax, fineRes, cellObjects, mins, maxs);
+        d_cells[top.firstCell + idx].level = level;
+    }
+}
+
+int Grid::intersect(Ray const &ray, Hit &hit) const
+{
+    int idx = closest(ray, hit);
+    if (idx >= 0)
+        d_objects[idx]->attributes(ray, hit);
+    return idx;
+}
+
+int Grid::closest(Ray const &ray, Hit &hit) const
+{
+    int closest = -1;
+    hit.t = numeric_limits<double>::infinity();
+
+    for (unsigned idx : d_unbounded)
+    {
+        Hit objHit;
+        d_objects[idx]->distance(ray, objHit);
+        if (objHit.t < hit.t && objHit.t > 0)
+        {
+            hit = objHit;
+            closest = idx;
+        }
+    }
+
+    if (d_levels.empty())
+        return closest;
+
+    Vector invD(1.0 / ray.D.x, 1.0 / ray.D.y, 1.0 / ray.D.z);
+    unsigned mailbox[MAILBOX];
+    fill(mailbox, mailbox + MAILBOX, numeric_limits<unsigned>::max());
+    traverse(d_levels[0], ray, invD, 0.0, hit, closest, mailbox);
+    return closest;
+}
+
+ObjectPtr const &Grid::object(unsigned idx) const
+{
+    return d_objects[idx];
+}
+
+size_t Grid::size() const
+{
+    return d_objects.size();
+}
+
+void Grid::resolution(unsigned res[3], unsigned &numFiner) const
+{
+    fill(res, res + 3, 0);
+    numFiner = 0;
+    if (d_levels.empty())
+        return;
+
+    copy(d_levels[0].res, d_levels[0].res + 3, res);
+    numFiner = d_levels.size() - 1;
+}
+
+void Grid::estimate(vector<Point> const &mins, vector<Point> const &maxs, bool twoLevel,
+                    double &buildCost, double &rayCost)
+{
+    buildCost = 0.0;
+    rayCost = 0.0;
+    if (mins.empty())
+        return;
+
+    // Only an even spread sample of the objects is put in a grid for it.
+    // The cells per object stay the same, so do the objects per cell; only
+    // the number of cells a ray crosses grows with the cube root.
+    unsigned stride = (mins.size() + MAX_SAMPLES - 1) / MAX_SAMPLES;
+    vector<unsigned> objects;
+    for (unsigned idx = 0; idx < mins.size(); idx += stride)
+        objects.push_back(idx);
+    double scale = static_cast<double>(mins.size()) / objects.size();
+
+    Point min;
+    Point max;
+    box(mins, maxs, objects, min, max);
+    unsigned res[3];
+    chooseResolution(min, max, objects.size(), twoLevel ? TOP_DENSITY : DENSITY, res);
+    Vector cellSize((max.x - min.x) / res[0], (max.y - min.y) / res[1],
+                    (max.z - min.z) / res[2]);
+
+    vector<unsigned> counts(res[0] * res[1] * res[2]);
+    for (unsigned idx : objects)
+        forEachCell(min, cellSize, res, mins[idx], maxs[idx], [&](unsigned cell)
+        {
+            ++counts[cell];
+        });
+
+    // Visiting a cell costs testing its objects, or for a full cell (two
+    // level) walking its finer grid, of about one object per cell, for a
+    // few cells. The cells are weighted by their number of objects: rays
+    // mostly go where the objects are.
+    double numRefs = 0.0;
+    double numUsed = 0.0;
+    double visitCost = 0.0;
+    for (unsigned count : counts)
+    {
+        if (count == 0)
+            continue;
+
+        numRefs += count;
+        numUsed += 1.0;
+        if (twoLevel && count > FULL_CELL)
+        {
+            double fineCells = DENSITY * count;
+            double fineSteps = 0.75 * cbrt(fineCells);
+            buildCost += CELL_BUILD_COST * fineCells + REF_BUILD_COST * count;
+            visitCost += count * (ENTER_COST + STEP_COST * fineSteps
+                                  + std::min(fineSteps, HIT_CELLS));
+        }
+        else
+            visitCost += count * count;
+    }
+    buildCost = scale * (buildCost + CELL_BUILD_COST * counts.size()
+                                   + REF_BUILD_COST * numRefs);
+
+    // A ray crosses half the cells along the axes on average, unless it
+    // hits something first: it stops after a few non-empty cells.
+    double crossed = cbrt(scale) * (res[0] + res[1] + res[2]) / 2.0;
+    double used = numUsed / counts.size();
+    double steps = std::min(crossed, HIT_CELLS / used);
+    double tests = visitCost / numRefs * std::min(used * steps, HIT_CELLS);
+    rayCost = ENTER_COST + STEP_COST * steps
+            + std::min(tests, static_cast<double>(mins.size()));
+}
+
+// --- Private -----------------------------------------------------------------
+
+unsigned Grid::addLevel(Point const &min, Point const &max, unsigned const res[3],
+                        vector<unsigned> const &objects,
+                        vector<Point> const &mins, vector<Point> const &maxs)
+{
+    Level level;
+    level.min = min;
+    level.max = max;
+    copy(res, res + 3, level.res);
+    level.cellSize = Vector((max.x - min.x) / res[0], (max.y - min.y) / res[1],
+                            (max.z - min.z) / res[2]);
+    level.firstCell = d_cells.size();
+
+    // count the objects of every cell, then put them in place
+    unsigned numCells = res[0] * res[1] * res[2];
+    d_cells.resize(d_cells.size() + numCells, Cell{0, 0, -1});
+    Cell *cells = d_cells.data() + level.firstCell;
+    for (unsigned idx : objects)
+        forEachCell(level.min, level.cellSize, res, mins[idx], maxs[idx], [&](unsigned cell)
+        {
+            ++cells[cell].count;
+        });
+
+    unsigned first = d_refs.size();
+    for (unsigned cell = 0; cell != numCells; ++cell)
+    {
+        cells[cell].first = first;
+        first += cells[cell].count;
+        cells[cell].count = 0;
+    }
+    d_refs.resize(first);
+
+    for (unsigned idx : objects)
+        forEachCell(level.min, level.cellSize, res, mins[idx], maxs[idx], [&](unsigned cell)
+        {
+            d_refs[cells[cell].first + cells[cell].count++] = idx;
+        });
+
+    d_levels.push_back(level);
+    return d_levels.size() - 1;
+}
+
+void Grid::traverse(Level const &level, Ray const &ray, Vector const &invD, double tMin,
+                    Hit &hit, int &closest, unsigned *mailbox) const
+{
+    // the part of the ray inside the grid, slab test as in BVH::hitsChildren
+    double tNear = tMin;
+    double tFar = numeric_limits<double>::infinity();
+    for (int axis = 0; axis != 3; ++axis)
+    {
+        double t1 = (level.min.data[axis] - ray.O.data[axis]) * invD.data[axis];
+        double t2 = (level.max.data[axis] - ray.O.data[axis]) * invD.data[axis];
+        if (t1 > t2)
+            swap(t1, t2);
+        tNear = t1 > tNear ? t1 : tNear;
+        tFar = t2 < tFar ? t2 : tFar;
+        if (tNear > tFar)
+            return;
+    }
+
+    // the cell the ray enters and, per axis, the distance at which it
+    // crosses into the next cell
+    Point entry = ray.at(tNear);
+    int cell[3];
+    int step[3];
+    int end[3];
+    double tNext[3];
+    double tDelta[3];
+    for (int axis = 0; axis != 3; ++axis)
+    {
+        double size = level.cellSize.data[axis];
+        cell[axis] = cellIndex((entry.data[axis] - level.min.data[axis]) / size,
+                               level.res[axis]);
+        double border = level.min.data[axis] + cell[axis] * size;
+        if (ray.D.data[axis] > 0)
+        {
+            step[axis] = 1;
+            end[axis] = level.res[axis];
+            tNext[axis] = (border + size - ray.O.data[axis]) * invD.data[axis];
+            tDelta[axis] = size * invD.data[axis];
+        }
+        else if (ray.D.data[axis] < 0)
+        {
+            step[axis] = -1;
+            end[axis] = -1;
+            tNext[axis] = (border - ray.O.data[axis]) * invD.data[axis];
+            tDelta[axis] = -size * invD.data[axis];
+        }
+        else
+        {
+            step[axis] = 0;
+            end[axis] = -1;
+            tNext[axis] = numeric_limits<double>::infinity();
+            tDelta[axis] = 0.0;
+        }
+    }
+
+    double tEnter = tNear;
+    while (true)
+    {
+        int axis = tNext[0] < tNext[1] ? (tNext[0] < tNext[2] ? 0 : 2)
+                                       : (tNext[1] < tNext[2] ? 1 : 2);
+        double tExit = tNext[axis];
+
+        Cell const &current = d_cells[level.firstCell
+                                      + (cell[2] * level.res[1] + cell[1]) * level.res[0]
+                                      + cell[0]];
+        if (current.level >= 0)
+            traverse(d_levels[current.level], ray, invD, tEnter, hit, closest, mailbox);
+        else if (current.count != 0)
+            test(current, ray, hit, closest, mailbox);
+
+        // a hit before the ray leaves the cell can not be beaten by the
+        // objects of the cells further on
+        if (hit.t < tExit)
+            return;
+
+        cell[axis] += step[axis];
+        if (cell[axis] == end[axis])
+            return;
+        tEnter = tExit;
+        tNext[axis] += tDelta[axis];
+    }
+}
+
+void Grid::test(Cell const &cell, Ray const &ray, Hit &hit, int &closest,
+                unsigned *mailbox) const
+{
+    for (unsigned pos = cell.first; pos != cell.first + cell.count; ++pos)
+    {
+        // objects in more than one cell are only tested once, mostly
+        unsigned idx = d_refs[pos];
+        unsigned &tested = mailbox[idx % MAILBOX];
+        if (tested == idx)
+            continue;
+        tested = idx;
+
+        Hit objHit;
+        d_objects[idx]->distance(ray, objHit);
+        // equal distances: the first object wins, as in a linear search
+        if ((objHit.t < hit.t || (objHit.t == hit.t && static_cast<int>(idx) < closest))
+            && objHit.t > 0)
+        {
+            hit = objHit;
+            closest = idx;
+        }
+    }
+}
+
+void Grid::box(vector<Point> const &mins, vector<Point> const &maxs,
+               vector<unsigned> const &objects, Point &min, Point &max)
+{
+    min = mins[objects[0]];
+    max = maxs[objects[0]];
+    for (unsigned idx : objects)
+    {
+        for (int axis = 0; axis != 3; ++axis)
+        {
+            min.data[axis] = std::min(min.data[axis], mins[idx].data[axis]);
+            max.data[axis] = std::max(max.data[axis], maxs[idx].data[axis]);
+        }
+    }
+
+    // a little wider, so no cell is flat and the objects on the border
+    // are inside
+    double pad = 1e-6 * (max - min).length() + 1e-9;
+    min -= pad;
+    max += pad;
+}
+
+void Grid::chooseResolution(Point const &min, Point const &max, size_t count,
+                            double density, unsigned res[3])
+{
+    // cubic cells, as many as density per object. An axis along which the
+    // box is thinner than a cell gets one cell, and the others share the
+    // cells.
+    Vector extent = max - min;
+    bool thin[3] = {false, false, false};
+    double perUnit = 0.0;               // cells per unit of length
+    for (int round = 0; round != 3; ++round)
+    {
+        double volume = 1.0;
+        int dims = 0;
+        for (int axis = 0; axis != 3; ++axis)
+        {
+            if (!thin[axis])
+            {
+                volume *= extent.data[axis];
+                ++dims;
+            }
+        }
+        if (dims == 0)
+            break;
+
+        perUnit = pow(density * count / volume, 1.0 / dims);
+        bool done = true;
+        for (int axis = 0; axis != 3; ++axis)
+        {
+            if (!thin[axis] && extent.data[axis] * perUnit < 1.0)
+            {
+                thin[axis] = true;
+                done = false;
+            }
+        }
+        if (done)
+            break;
+    }
+
+    for (int axis = 0; axis != 3; ++axis)
+    {
+        double cells = thin[axis] ? 1.0 : extent.data[axis] * perUnit + 0.5;
+        res[axis] = static_cast<unsigned>(std::min(cells, static_cast<double>(MAX_RES)));
+    }
+}
+
+template <typename Visitor>
+void Grid::forEachCell(Point const &min, Vector const &cellSize, unsigned const res[3],
+                       Point const &boxMin, Point const &boxMax, Visitor visit)
+{
+    // the box is widened a little, so a ray crossing into the next cell
+    // right at the object does not miss it because of round off
+    unsigned lo[3];
+    unsigned hi[3];
+    for (int axis = 0; axis != 3; ++axis)
+    {
+        double pad = 1e-6 * cellSize.data[axis];
+        lo[axis] = cellIndex((boxMin.data[axis] - pad - min.data[axis]) / cellSize.data[axis],
+                             res[axis]);
+        hi[axis] = cellIndex((boxMax.data[axis] + pad - min.data[axis]) / cellSize.data[axis],
+                             res[axis]);
+    }
+
+    for (unsigned z = lo[2]; z <= hi[2]; ++z)
+        for (unsigned y = lo[1]; y <= hi[1]; ++y)
+            for (unsigned x = lo[0]; x <= hi[0]; ++x)
+                visit((z * res[1] + y) * res[0] + x);
+}
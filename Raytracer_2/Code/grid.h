@@ -0,0 +1,108 @@
+#ifndef GRID_H_
+#define GRID_H_
+
+#include "object.h"
+#include "triple.h"
+
+#include <vector>
+
+// Forward declerations
+class Hit;
+class Ray;
+
+/**
+ * Regular grid of cells over the bounding box of the objects, every cell
+ * lists the objects whose bounding boxes overlap it. A ray walks through
+ * the cells it passes in order (3D DDA) and stops at the first cell that
+ * contains its closest hit. Building one only takes two passes over the
+ * objects, which makes it cheaper than a BVH for scenes of many objects
+ * of about the same size (particle fields of spheres).
+ *
+ * The two level grid starts with a coarse grid and gives every cell with
+ * many objects a finer grid of its own, so clusters of small objects do
+ * not end up in a few overfull cells.
+ *
+ * Unbounded objects (planes) are kept apart and tested for every ray, as
+ * in the BVH.
+ */
+class Grid
+{
+    struct Level                // a grid over a box
+    {
+        Point min;
+        Point max;
+        Vector cellSize;
+        unsigned res[3];        // number of cells along the axes
+        unsigned firstCell;     // its cells, x fastest, start here
+    };
+
+    struct Cell
+    {
+        unsigned first;         // range in d_refs
+        unsigned count;
+        int level;              // finer grid of the cell, -1 if none
+    };
+
+    std::vector<ObjectPtr> d_objects;
+    std::vector<Level> d_levels;        // the top grid is the first
+    std::vector<Cell> d_cells;
+    std::vector<unsigned> d_refs;       // objects of the cells
+    std::vector<unsigned> d_unbounded;
+
+    public:
+
+        // twoLevel: give the full cells a grid of their own
+        void build(std::vector<ObjectPtr> const &objects, bool twoLevel);
+
+        // closest hit in front of the ray origin, as BVH::intersect
+        int intersect(Ray const &ray, Hit &hit) const;
+
+        // as intersect, only the distance, as BVH::closest
+        int closest(Ray const &ray, Hit &hit) const;
+
+        ObjectPtr const &object(unsigned idx) const;
+        size_t size() const;
+
+        // the cells along the axes of the top grid, and the number of
+        // finer grids (two level)
+        void resolution(unsigned res[3], unsigned &numFiner) const;
+
+        // Estimated cost, in ray-object tests, of building the grid over
+        // the boxes of the bounded objects and of tracing one ray
+        // through it. Takes one pass over the objects, the grid itself is
+        // not built.
+        static void estimate(std::vector<Point> const &mins, std::vector<Point> const &maxs,
+                             bool twoLevel, double &buildCost, double &rayCost);
+
+    private:
+
+        // appends a grid of res cells over [min, max] with the objects
+        // (indices in mins and maxs) overlapping them
+        unsigned addLevel(Point const &min, Point const &max, unsigned const res[3],
+                          std::vector<unsigned> const &objects,
+                          std::vector<Point> const &mins, std::vector<Point> const &maxs);
+
+        // walks the ray through the cells of a grid from tMin on
+        void traverse(Level const &level, Ray const &ray, Vector const &invD, double tMin,
+                      Hit &hit, int &closest, unsigned *mailbox) const;
+
+        void test(Cell const &cell, Ray const &ray, Hit &hit, int &closest,
+                  unsigned *mailbox) const;
+
+        // bounding box of the objects (indices in mins and maxs)
+        static void box(std::vector<Point> const &mins, std::vector<Point> const &maxs,
+                        std::vector<unsigned> const &objects, Point &min, Point &max);
+
+        // number of cells along the axes for count objects in [min, max],
+        // about density cells per object
+        static void chooseResolution(Point const &min, Point const &max, size_t count,
+                                     double density, unsigned res[3]);
+
+        // calls visit(cell index) for every cell overlapping [boxMin, boxMax]
+        template <typename Visitor>
+        static void forEachCell(Point const &min, Vector const &cellSize,
+                                unsigned const res[3], Point const &boxMin,
+                                Point const &boxMax, Visitor visit);
+};
+
+#endif
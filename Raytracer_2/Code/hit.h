@@ -7,13 +7,25 @@
 class Hit
 {
     public:
-        double t;   // distance of hit
-        Vector N;   // Normal at hit
+        double t;           // distance of hit
+        Vector N;           // Normal at hit
+        double b1;          // barycentric coordinates (triangles)
+        double b2;
+        float u;            // texture coordinates, for textured materials
+        float v;
+        unsigned primitive; // part of the object that was hit (a triangle
+                            // of a quad, a shape of an instance)
 
-        Hit(double time, Vector const &normal)
+        Hit(double time = std::numeric_limits<double>::quiet_NaN(),
+            Vector const &normal = Vector())
         :
             t(time),
-            N(normal)
+            N(normal),
+            b1(0.0),
+            b2(0.0),
+            u(0.0f),
+            v(0.0f),
+            primitive(0)
         {}
 
         static Hit const NO_HIT()
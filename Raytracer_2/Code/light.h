@@ -3,21 +3,89 @@
 
 #include "triple.h"
 
+#include <cmath>
+
 // Declare LightPtr for use in Scene class
-#include <memory>
 class Light;
-typedef std::shared_ptr<Light> LightPtr;
+typedef Light *LightPtr;        // the lights are owned by the Arena of the scene
 
+/**
+ * Point light, or an area light: a rectangle or a sphere. Area lights are
+ * shaded as a point light at their centre, only their shadows are soft:
+ * the fraction of the light reaching a point is estimated with shadow rays
+ * from up to 'samples' points on the light (see Scene::shadowFraction).
+ */
 class Light
 {
     public:
-        Point const position;
+        enum Shape
+        {
+            POINT,
+            RECTANGLE,
+            SPHERE
+        };
+
+        Point const position;   // centre of area lights
         Color const color;
+        Shape const shape;
+        Vector const edge1;     // rectangle: its sides from corner to corner
+        Vector const edge2;
+        double const radius;    // sphere
+        unsigned const samples; // shadow rays of area lights, at most
 
         Light(Point const &pos, Color const &c)
+        :
+            Light(pos, c, POINT, Vector(), Vector(), 0.0, 1)
+        {}
+
+        // rectangle with the sides edge1 and edge2 around centre
+        Light(Point const &centre, Vector const &side1, Vector const &side2, Color const &c,
+              unsigned numSamples)
+        :
+            Light(centre, c, RECTANGLE, side1, side2, 0.0, numSamples)
+        {}
+
+        Light(Point const &centre, double r, Color const &c, unsigned numSamples)
+        :
+            Light(centre, c, SPHERE, Vector(), Vector(), r, numSamples)
+        {}
+
+        bool area() const
+        {
+            return shape != POINT;
+        }
+
+        // Point on the light for (a, b) in [0, 1)^2, as seen from hit. For
+        // a sphere only its disc facing hit is sampled, which is what
+        // casts the shadows.
+        Point sample(Point const &hit, double a, double b) const
+        {
+            if (shape == RECTANGLE)
+                return position + (a - 0.5) * edge1 + (b - 0.5) * edge2;
+            if (shape == POINT)
+                return position;
+
+            Vector w = (hit - position).normalized();
+            Vector u = (std::fabs(w.x) > 0.5 ? Vector(0, 1, 0) : Vector(1, 0, 0)).cross(w);
+            u.normalize();
+            Vector v = w.cross(u);
+            double r = radius * std::sqrt(a);
+            double phi = 2 * M_PI * b;
+            return position + (r * std::cos(phi)) * u + (r * std::sin(phi)) * v;
+        }
+
+    private:
+
+        Light(Point const &pos, Color const &c, Shape s, Vector const &side1,
+              Vector const &side2, double r, unsigned numSamples)
         :
             position(pos),
-            color(c)
+            color(c),
+            shape(s),
+            edge1(side1),
+            edge2(side2),
+            radius(r),
+            samples(numSamples)
         {}
 };
 
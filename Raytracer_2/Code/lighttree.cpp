@@ -0,0 +1,138 @@
+#include "lighttree.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+void LightTree::build(vector<LightPtr> const &lights)
+{
+    d_nodes.clear();
+    if (lights.empty())
+        return;
+
+    vector<unsigned> indices(lights.size());
+    for (unsigned idx = 0; idx != indices.size(); ++idx)
+        indices[idx] = idx;
+
+    d_nodes.reserve(2 * lights.size() - 1);
+    build(lights, indices, 0, lights.size());
+}
+
+int LightTree::sample(Point const &hit, Vector const &N, double u, double &pdf) const
+{
+    pdf = 1.0;
+    if (d_nodes.empty() || importance(d_nodes[0], hit, N) <= 0.0)
+        return -1;
+
+    // walk down, choosing a child proportional to its importance. The
+    // random number is rescaled at every step so it can be reused.
+    unsigned idx = 0;
+    while (d_nodes[idx].light < 0)
+    {
+        unsigned left = idx + 1;
+        unsigned right = d_nodes[idx].right;
+        double leftImportance = importance(d_nodes[left], hit, N);
+        double rightImportance = importance(d_nodes[right], hit, N);
+        if (leftImportance + rightImportance <= 0.0)
+            return -1;
+
+        double p = leftImportance / (leftImportance + rightImportance);
+        if (u < p)
+        {
+            u /= p;
+            pdf *= p;
+            idx = left;
+        }
+        else
+        {
+            u = (u - p) / (1.0 - p);
+            pdf *= 1.0 - p;
+            idx = right;
+        }
+    }
+    return d_nodes[idx].light;
+}
+
+// --- Private -----------------------------------------------------------------
+
+// Builds the subtree of the lights indices[first, last) and returns the
+// index of its root. The lights are split at the median of the longest
+// axis of their bounding box.
+unsigned LightTree::build(vector<LightPtr> const &lights, vector<unsigned> &indices,
+                          unsigned first, unsigned last)
+{
+    unsigned nodeIdx = d_nodes.size();
+    d_nodes.push_back(Node());
+
+    Node node;
+    node.min = node.max = lights[indices[first]]->position;
+    node.intensity = 0.0;
+    node.right = 0;
+    node.light = -1;
+    for (unsigned idx = first; idx != last; ++idx)
+    {
+        Light const &light = *lights[indices[idx]];
+        for (int axis = 0; axis != 3; ++axis)
+        {
+            node.min.data[axis] = min(node.min.data[axis], light.position.data[axis]);
+            node.max.data[axis] = max(node.max.data[axis], light.position.data[axis]);
+        }
+        node.intensity += light.color.r + light.color.g + light.color.b;
+    }
+
+    if (last - first == 1)
+        node.light = indices[first];
+    else
+    {
+        Vector extent = node.max - node.min;
+        int axis = 0;
+        if (extent.y > extent.data[axis]) axis = 1;
+        if (extent.z > extent.data[axis]) axis = 2;
+
+        unsigned middle = first + (last - first) / 2;
+        nth_element(indices.begin() + first, indices.begin() + middle, indices.begin() + last,
+            [&](unsigned lhs, unsigned rhs)
+            {
+                return lights[lhs]->position.data[axis] < lights[rhs]->position.data[axis];
+            });
+
+        build(lights, indices, first, middle);  // left child is the next node
+        node.right = build(lights, indices, middle, last);
+    }
+
+    d_nodes[nodeIdx] = node;
+    return nodeIdx;
+}
+
+// true if all lights of the node are behind (or in) the tangent plane at
+// hit, then they can not light the surface
+bool LightTree::behind(Node const &node, Point const &hit, Vector const &N)
+{
+    // the corner of the box furthest in the direction of the normal
+    Point corner(N.x > 0 ? node.max.x : node.min.x,
+                 N.y > 0 ? node.max.y : node.min.y,
+                 N.z > 0 ? node.max.z : node.min.z);
+    return N.dot(corner - hit) <= 0.0;
+}
+
+// Estimated contribution of the lights of a node. There is no falloff with
+// distance, so it only depends on the intensity and the angle of incidence.
+// For a leaf this is exact, for inner nodes a (non-zero) estimate.
+double LightTree::importance(Node const &node, Point const &hit, Vector const &N)
+{
+    if (behind(node, hit, N))
+        return 0.0;
+
+    if (node.light >= 0)
+        return node.intensity * N.dot((node.min - hit).normalized());
+
+    bool inside = hit.x >= node.min.x && hit.x <= node.max.x
+               && hit.y >= node.min.y && hit.y <= node.max.y
+               && hit.z >= node.min.z && hit.z <= node.max.z;
+    if (inside)
+        return node.intensity;
+
+    Point center = (node.min + node.max) / 2.0;
+    return node.intensity * max(0.1, N.dot((center - hit).normalized()));
+}
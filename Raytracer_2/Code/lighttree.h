@@ -0,0 +1,76 @@
+#ifndef LIGHTTREE_H_
+#define LIGHTTREE_H_
+
+#include "light.h"
+#include "triple.h"
+
+#include <vector>
+
+/**
+ * Bounding volume hierarchy over the point lights of a scene. Used to
+ * skip all lights behind the surface at a shading point at once, and to
+ * pick lights at random proportional to their estimated contribution
+ * (many-light scenes with "LightSamples").
+ */
+class LightTree
+{
+    struct Node
+    {
+        Point min;              // bounding box of the lights in the node
+        Point max;
+        double intensity;       // summed intensity of the lights
+        unsigned right;         // index of right child, left is next node
+        int light;              // index of the light for leaves, else -1
+    };
+
+    std::vector<Node> d_nodes;
+
+    public:
+
+        void build(std::vector<LightPtr> const &lights);
+
+        // calls visit(index) for every light in front of the surface
+        // through hit with normal N
+        template <typename Visitor>
+        void forEachInFront(Point const &hit, Vector const &N, Visitor visit) const;
+
+        // picks a light proportional to its estimated contribution, using
+        // the uniform random number u. Returns its index and probability
+        // in pdf, or -1 if no light can contribute.
+        int sample(Point const &hit, Vector const &N, double u, double &pdf) const;
+
+    private:
+
+        unsigned build(std::vector<LightPtr> const &lights, std::vector<unsigned> &indices,
+                       unsigned first, unsigned last);
+
+        static bool behind(Node const &node, Point const &hit, Vector const &N);
+        static double importance(Node const &node, Point const &hit, Vector const &N);
+};
+
+template <typename Visitor>
+void LightTree::forEachInFront(Point const &hit, Vector const &N, Visitor visit) const
+{
+    if (d_nodes.empty())
+        return;
+
+    unsigned stack[64];
+    unsigned size = 0;
+    stack[size++] = 0;
+    while (size != 0)
+    {
+        Node const &node = d_nodes[stack[--size]];
+        if (behind(node, hit, N))
+            continue;                   // culls the whole subtree
+
+        if (node.light >= 0)
+            visit(static_cast<unsigned>(node.light));
+        else
+        {
+            stack[size++] = node.right;
+            stack[size++] = &node - d_nodes.data() + 1;
+        }
+    }
+}
+
+#endif
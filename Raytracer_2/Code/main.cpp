@@ -1,44 +1,120 @@
 #include "raytracer.h"
 
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <string>
+#include <vector>
 
 using namespace std;
 
+namespace
+{
+    // parses "x,y,width,height"
+    bool parseRegion(string const &text, Region &region)
+    {
+        char end;
+        return sscanf(text.c_str(), "%u,%u,%u,%u%c", &region.x, &region.y,
+                      &region.width, &region.height, &end) == 4;
+    }
+}
+
 int main(int argc, char *argv[])
 {
     cout << "Introduction to Computer Graphics - Raytracer\n\n";
 
-    if (argc < 2 || argc > 3)
+    // options come before the file names
+    vector<Region> regions;
+    string composite;
+    double checkpointInterval = 0;
+    bool resume = false;
+    string coordinator;
+    string worker;
+    vector<string> files;
+    bool valid = true;
+    for (int idx = 1; idx < argc; ++idx)
     {
-        cerr << "Usage: " << argv[0] << "in-file [out-file.png]\n";
+        string arg = argv[idx];
+        if (arg == "--region" && idx + 1 < argc)
+        {
+            Region region;
+            valid = valid && parseRegion(argv[++idx], region);
+            regions.push_back(region);
+        }
+        else if (arg == "--composite" && idx + 1 < argc)
+            composite = argv[++idx];
+        else if (arg == "--checkpoint" && idx + 1 < argc)
+        {
+            char *end;
+            checkpointInterval = strtod(argv[++idx], &end);
+            valid = valid && *end == '\0' && checkpointInterval > 0;
+        }
+        else if (arg == "--resume")
+            resume = true;
+        else if (arg == "--coordinator" && idx + 1 < argc)
+            coordinator = argv[++idx];
+        else if (arg == "--worker" && idx + 1 < argc)
+            worker = argv[++idx];
+        else if (arg.compare(0, 2, "--") == 0)
+            valid = false;
+        else
+            files.push_back(arg);
+    }
+
+    // a worker writes no image
+    valid = valid && (coordinator.empty() || worker.empty());
+    if (!valid || files.size() < 1 || files.size() > (worker.empty() ? 2 : 1))
+    {
+        cerr << "Usage: " << argv[0] << " [--region x,y,width,height]... "
+                "[--composite image.png]\n"
+                "       [--checkpoint seconds] [--resume] [--coordinator address]\n"
+                "       in-file [out-file.png]\n"
+                "   or: " << argv[0] << " --worker address in-file\n";
         return 1;
     }
 
     Raytracer raytracer;
 
     // read the scene
-    if (!raytracer.readScene(argv[1]))
+    if (!raytracer.readScene(files[0]))
     {
-        cerr << "Error: reading scene from " << argv[1] <<
+        cerr << "Error: reading scene from " << files[0] <<
             " failed - no output generated.\n";
         return 1;
     }
 
+    // the command line overrides the regions of the scene file
+    if (!regions.empty())
+        raytracer.setRegions(regions);
+    if (!composite.empty())
+        raytracer.setComposite(composite);
+    if (checkpointInterval > 0)
+        raytracer.setCheckpointInterval(checkpointInterval);
+    raytracer.setResume(resume);
+
+    if (!worker.empty())
+        return raytracer.runWorker(worker) ? 0 : 1;
+
     // determine output name
     string ofname;
-    if (argc >= 3)
+    if (files.size() >= 2)
     {
-        ofname = argv[2];   // use the provided name
+        ofname = files[1];  // use the provided name
     }
     else
     {
-        ofname = argv[1];   // replace .json with .png
+        ofname = files[0];  // replace .json with .png
         ofname.erase(ofname.begin() + ofname.find_last_of('.'), ofname.end());
         ofname += ".png";
     }
 
-    raytracer.renderToFile(ofname);
+    bool rendered = coordinator.empty() ? raytracer.renderToFile(ofname)
+                                        : raytracer.renderDistributed(ofname, coordinator);
+    if (!rendered)
+    {
+        cerr << "Error: rendering to " << ofname << " failed.\n";
+        return 1;
+    }
 
     return 0;
 }
@@ -0,0 +1,61 @@
+#include "mappedfile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+MappedFile::MappedFile(string const &filename)
+:
+    d_data(nullptr),
+    d_size(0)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        void *mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED)
+        {
+            d_data = mapped;
+            d_size = st.st_size;
+        }
+    }
+    close(fd);                      // the mapping stays valid
+}
+
+MappedFile::~MappedFile()
+{
+    if (d_data)
+        munmap(d_data, d_size);
+}
+
+bool MappedFile::valid() const
+{
+    return d_data != nullptr;
+}
+
+char const *MappedFile::data() const
+{
+    return static_cast<char const *>(d_data);
+}
+
+size_t MappedFile::size() const
+{
+    return d_size;
+}
+
+void MappedFile::prefetch(size_t offset, size_t length) const
+{
+    madvise(static_cast<char *>(d_data) + offset, length, MADV_WILLNEED);
+}
+
+void MappedFile::release(size_t offset, size_t length) const
+{
+    madvise(static_cast<char *>(d_data) + offset, length, MADV_DONTNEED);
+}
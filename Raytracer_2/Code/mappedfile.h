@@ -0,0 +1,37 @@
+#ifndef MAPPEDFILE_H_
+#define MAPPEDFILE_H_
+
+#include <cstddef>
+#include <string>
+
+/**
+ * Read-only memory mapping of a whole file. The mapping is released when
+ * the object is destroyed. Check valid() before using the data, mapping
+ * fails for files that do not exist or are empty.
+ */
+class MappedFile
+{
+    void *d_data;
+    size_t d_size;
+
+    public:
+
+        explicit MappedFile(std::string const &filename);
+        ~MappedFile();
+
+        MappedFile(MappedFile const &other) = delete;
+        MappedFile &operator=(MappedFile const &other) = delete;
+
+        bool valid() const;
+        char const *data() const;
+        size_t size() const;
+
+        // Hints for the pages of a range of the file (offset a multiple of
+        // the page size): prefetch reads them in ahead of use, release
+        // drops them from memory. Released pages are read from the file
+        // again when they are used, so the data stays valid.
+        void prefetch(size_t offset, size_t length) const;
+        void release(size_t offset, size_t length) const;
+};
+
+#endif
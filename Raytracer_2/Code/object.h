@@ -1,23 +1,21 @@
 #ifndef OBJECT_H_
 #define OBJECT_H_
 
-#include "material.h"
-
 // not really needed here, but deriving classes may need them
 #include "hit.h"
 #include "ray.h"
 #include "triple.h"
 #include "image.h"
 
+#include <cstdint>
 #include <tuple>
-#include <memory>
 class Object;
-typedef std::shared_ptr<Object> ObjectPtr;
+typedef Object *ObjectPtr;      // the objects are owned by the Arena of the scene
 
 class Object
 {
     public:
-        Material material;
+        uint32_t material = 0;  // index in the material table of the scene
 
         virtual ~Object() = default;
 
@@ -26,6 +24,28 @@ class Object
         virtual Hit intersect(Ray const &ray) = 0;  // must be implemented
                                                     // in derived class
 
+        // Intersection in two phases. distance is called for every
+        // candidate object and only has to set hit.t (NaN if the ray
+        // misses) and what attributes needs later (primitive, b1, b2).
+        // attributes is only called for the closest hit and sets the
+        // normal. The defaults do the whole intersect in the first phase.
+        // The texture coordinates are left to the scene, which knows the
+        // material (see Scene::mapTexture).
+        virtual void distance(Ray const &ray, Hit &hit)
+        {
+            hit = intersect(ray);
+        }
+
+        virtual void attributes(Ray const &ray, Hit &hit)
+        {}
+
+        // axis aligned bounding box, used by the acceleration structure.
+        // Returns false for unbounded shapes (the default), which are
+        // tested against every ray.
+        virtual bool bounds(Point &min, Point &max)
+        {
+            return false;
+        }
 };
 
 #endif
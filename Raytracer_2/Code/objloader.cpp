@@ -3,9 +3,15 @@
 // Pro C++ Tip: here you can specify other includes you may need
 // such as <iostream>
 
+#include "filestamp.h"
+#include "mappedfile.h"
+
+#include <algorithm>
+#include <cstdio>       // rename, remove
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iostream>
-#include <sstream>
 
 using namespace std;
 
@@ -17,9 +23,19 @@ using namespace std;
 
 OBJLoader::OBJLoader(string const &filename)
 :
-    d_hasTexCoords(false)
+    d_hasTexCoords(false),
+    d_boundsMin{0, 0, 0},
+    d_boundsMax{0, 0, 0}
 {
-    parseFile(filename);
+    if (readCache(filename))
+        return;
+
+    if (parseFile(filename))
+    {
+        computeBounds();
+        if (!writeCache(filename))
+            cerr << "Warning: could not write mesh cache " << filename << ".cache\n";
+    }
 }
 
 // ===================================================================
@@ -65,6 +81,20 @@ vector<Vertex> OBJLoader::vertex_data() const
     return data;    // copy elision
 }
 
+vector<float> OBJLoader::positions() const
+{
+    vector<float> data;
+    data.reserve(3 * d_vertices.size());
+    for (Vertex_idx const &vertex : d_vertices)
+    {
+        vec3 const coord = d_coordinates.at(vertex.d_coord);
+        data.push_back(coord.x);
+        data.push_back(coord.y);
+        data.push_back(coord.z);
+    }
+    return data;
+}
+
 unsigned OBJLoader::numTriangles() const
 {
     return d_vertices.size() / 3U;
@@ -75,6 +105,16 @@ bool OBJLoader::hasTexCoords() const
     return d_hasTexCoords;
 }
 
+void OBJLoader::bounds(float min[3], float max[3]) const
+{
+    min[0] = d_boundsMin.x;
+    min[1] = d_boundsMin.y;
+    min[2] = d_boundsMin.z;
+    max[0] = d_boundsMax.x;
+    max[1] = d_boundsMax.y;
+    max[2] = d_boundsMax.z;
+}
+
 void OBJLoader::unitize()
 {
     // TODO: implement this yourself!
@@ -104,102 +144,409 @@ void OBJLoader::unitize()
 
 // --- Private -------------------------------------------------------
 
-void OBJLoader::parseFile(string const &filename)
+namespace
 {
-    ifstream file(filename);
-    if (file)
+    // Files are split in chunks of about this size which are parsed
+    // independently (and in parallel when OpenMP is enabled)
+    size_t const CHUNK_SIZE = 1 << 20;
+    size_t const MAX_CHUNKS = 256;
+
+    enum LineType
+    {
+        LINE_OTHER,
+        LINE_VERTEX,
+        LINE_NORMAL,
+        LINE_TEXCOORD,
+        LINE_FACE
+    };
+
+    bool isSpace(char ch)
     {
-        string line;
-        while(getline(file, line))
-            parseLine(line);
+        return ch == ' ' || ch == '\t' || ch == '\r';
+    }
 
-    } else {
-        cerr << "Could not open: " << filename << " for reading!\n";
+    char const *skipSpace(char const *pos, char const *end)
+    {
+        while (pos != end && isSpace(*pos))
+            ++pos;
+        return pos;
+    }
+
+    char const *tokenEnd(char const *pos, char const *end)
+    {
+        while (pos != end && !isSpace(*pos))
+            ++pos;
+        return pos;
+    }
+
+    char const *lineEnd(char const *pos, char const *end)
+    {
+        char const *newline = static_cast<char const *>(memchr(pos, '\n', end - pos));
+        return newline ? newline : end;
+    }
+
+    // determines the type of the line and moves pos past the keyword
+    LineType lineType(char const *&pos, char const *end)
+    {
+        pos = skipSpace(pos, end);
+        char const *keyEnd = tokenEnd(pos, end);
+        size_t length = keyEnd - pos;
+        char const *key = pos;
+        pos = keyEnd;
+
+        if (length == 1 && key[0] == 'v')
+            return LINE_VERTEX;
+        if (length == 2 && key[0] == 'v' && key[1] == 'n')
+            return LINE_NORMAL;
+        if (length == 2 && key[0] == 'v' && key[1] == 't')
+            return LINE_TEXCOORD;
+        if (length == 1 && key[0] == 'f')
+            return LINE_FACE;
+
+        return LINE_OTHER;          // comments and other data are ignored
+    }
+
+    // Reads the next float of the line. The token is copied to a buffer
+    // on the stack, because the mapped file is not '\0' terminated.
+    bool readFloat(char const *&pos, char const *end, float &value)
+    {
+        pos = skipSpace(pos, end);
+        char const *last = tokenEnd(pos, end);
+
+        char buffer[64];
+        size_t length = last - pos;
+        if (length == 0 || length >= sizeof(buffer))
+            return false;
+
+        memcpy(buffer, pos, length);
+        buffer[length] = '\0';
+        pos = last;
+
+        char *parsed;
+        value = strtof(buffer, &parsed);
+        return parsed == buffer + length;
+    }
+
+    // Reads a (possibly negative) index, returns 0 if there is none
+    long readIndex(char const *&pos, char const *end)
+    {
+        bool negative = pos != end && *pos == '-';
+        if (negative)
+            ++pos;
+
+        long value = 0;
+        while (pos != end && *pos >= '0' && *pos <= '9')
+            value = value * 10 + (*pos++ - '0');
+
+        return negative ? -value : value;
+    }
+
+    // Wavefront .obj files start counting from 1 (yuck), negative
+    // indices are relative to the number of elements read so far
+    uint32_t toIndex(long index, size_t count)
+    {
+        if (index > 0)
+            return index - 1;
+        if (index < 0)
+            return count + index;
+        return 0;                   // missing index
     }
 }
 
-void OBJLoader::parseLine(string const &line)
+bool OBJLoader::parseFile(string const &filename)
 {
-    if (line[0] == '#')
-        return;                     // ignore comments
+    MappedFile file(filename);
+    if (!file.valid())
+    {
+        cerr << "Could not open: " << filename << " for reading!\n";
+        return false;
+    }
 
-    StringList tokens = split(line, ' ', false);
+    char const *begin = file.data();
+    char const *end = begin + file.size();
+
+    // Split the file in chunks, each chunk ends at the end of a line
+    size_t const numChunks = min(MAX_CHUNKS, file.size() / CHUNK_SIZE + 1);
+    vector<char const *> bounds(numChunks + 1, end);
+    bounds[0] = begin;
+    for (size_t chunk = 1; chunk < numChunks; ++chunk)
+    {
+        char const *pos = max(bounds[chunk - 1], begin + file.size() * chunk / numChunks);
+        pos = lineEnd(pos, end);
+        bounds[chunk] = pos == end ? end : pos + 1;
+    }
+
+    // Pre-scan: count the elements of each chunk, so the storage can be
+    // allocated once and every chunk knows where its elements go
+    vector<LineCounts> counts(numChunks);
+
+    #pragma omp parallel for schedule(dynamic)
+    for (size_t chunk = 0; chunk < numChunks; ++chunk)
+        counts[chunk] = countLines(bounds[chunk], bounds[chunk + 1]);
+
+    vector<LineCounts> offsets(numChunks);
+    LineCounts total {};
+    for (size_t chunk = 0; chunk != numChunks; ++chunk)
+    {
+        offsets[chunk] = total;
+        total.d_coords += counts[chunk].d_coords;
+        total.d_norms += counts[chunk].d_norms;
+        total.d_texs += counts[chunk].d_texs;
+        total.d_vertices += counts[chunk].d_vertices;
+    }
 
-    if (tokens[0] == "v")
-        parseVertex(tokens);
-    else if (tokens[0] == "vn")
-        parseNormal(tokens);
-    else if (tokens[0] == "vt")
-        parseTexCoord(tokens);
-    else if (tokens[0] == "f")
-        parseFace(tokens);
+    d_hasTexCoords = total.d_texs > 0;  // Texture data will be read
+    d_coordinates.resize(total.d_coords);
+    d_normals.resize(total.d_norms);
+    d_texCoords.resize(total.d_texs);
+    d_vertices.resize(total.d_vertices);
 
-    // Other data is also ignored
+    size_t malformed = 0;
+
+    #pragma omp parallel for schedule(dynamic) reduction(+:malformed)
+    for (size_t chunk = 0; chunk < numChunks; ++chunk)
+        malformed += parseChunk(bounds[chunk], bounds[chunk + 1], offsets[chunk]);
+
+    if (malformed != 0)
+        cerr << "Warning: " << malformed << " malformed lines in " << filename << "\n";
+    return true;
 }
 
-void OBJLoader::parseVertex(StringList const &tokens)
+void OBJLoader::computeBounds()
 {
-    float x, y, z;
-    x = stof(tokens.at(1));         // 0 is the "v" token
-    y = stof(tokens.at(2));
-    z = stof(tokens.at(3));
-    d_coordinates.push_back(vec3{x, y, z});
+    if (d_coordinates.empty())
+        return;
+
+    d_boundsMin = d_boundsMax = d_coordinates[0];
+    for (vec3 const &coord : d_coordinates)
+    {
+        d_boundsMin.x = min(d_boundsMin.x, coord.x);
+        d_boundsMin.y = min(d_boundsMin.y, coord.y);
+        d_boundsMin.z = min(d_boundsMin.z, coord.z);
+        d_boundsMax.x = max(d_boundsMax.x, coord.x);
+        d_boundsMax.y = max(d_boundsMax.y, coord.y);
+        d_boundsMax.z = max(d_boundsMax.z, coord.z);
+    }
 }
 
-void OBJLoader::parseNormal(StringList const &tokens)
+OBJLoader::LineCounts OBJLoader::countLines(char const *begin, char const *end)
 {
-    float x, y, z;
-    x = stof(tokens.at(1));         // 0 is the "vn" token
-    y = stof(tokens.at(2));
-    z = stof(tokens.at(3));
-    d_normals.push_back(vec3{x, y, z});
+    LineCounts counts {};
+    for (char const *pos = begin; pos != end; )
+    {
+        char const *last = lineEnd(pos, end);
+        switch (lineType(pos, last))
+        {
+            case LINE_VERTEX:
+                ++counts.d_coords;
+                break;
+            case LINE_NORMAL:
+                ++counts.d_norms;
+                break;
+            case LINE_TEXCOORD:
+                ++counts.d_texs;
+                break;
+            case LINE_FACE:
+                // one vertex per token
+                while ((pos = skipSpace(pos, last)) != last)
+                {
+                    pos = tokenEnd(pos, last);
+                    ++counts.d_vertices;
+                }
+                break;
+            default:
+                break;
+        }
+        pos = last == end ? end : last + 1;
+    }
+    return counts;
 }
 
-void OBJLoader::parseTexCoord(StringList const &tokens)
+// Parses the lines of a chunk into the storage reserved for it, starting
+// at the given offsets. Returns the number of malformed lines.
+size_t OBJLoader::parseChunk(char const *begin, char const *end,
+                             LineCounts const &offset)
 {
-    d_hasTexCoords = true;          // Texture data will be read
+    size_t coord = offset.d_coords;
+    size_t norm = offset.d_norms;
+    size_t tex = offset.d_texs;
+    size_t vertex = offset.d_vertices;
+    size_t malformed = 0;
 
-    float u, v;
-    u = stof(tokens.at(1));         // 0 is the "vt" token
-    v = stof(tokens.at(2));
-    d_texCoords.push_back(vec2{u, v});
+    for (char const *pos = begin; pos != end; )
+    {
+        char const *last = lineEnd(pos, end);
+        bool ok = true;
+        switch (lineType(pos, last))
+        {
+            case LINE_VERTEX:
+            {
+                vec3 &v = d_coordinates[coord++];
+                ok = readFloat(pos, last, v.x) && readFloat(pos, last, v.y)
+                  && readFloat(pos, last, v.z);
+                break;
+            }
+            case LINE_NORMAL:
+            {
+                vec3 &n = d_normals[norm++];
+                ok = readFloat(pos, last, n.x) && readFloat(pos, last, n.y)
+                  && readFloat(pos, last, n.z);
+                break;
+            }
+            case LINE_TEXCOORD:
+            {
+                vec2 &t = d_texCoords[tex++];
+                ok = readFloat(pos, last, t.u) && readFloat(pos, last, t.v);
+                break;
+            }
+            case LINE_FACE:
+                // format is:
+                // <vertex idx + 1>/<texture idx +1>/<normal idx + 1>
+                // where the texture and normal indices are optional
+                while ((pos = skipSpace(pos, last)) != last)
+                {
+                    char const *token = tokenEnd(pos, last);
+                    Vertex_idx &vert = d_vertices[vertex++];
+
+                    vert.d_coord = toIndex(readIndex(pos, token), coord);
+                    vert.d_tex = 0U;
+                    vert.d_norm = 0U;
+                    if (pos != token && *pos == '/')
+                    {
+                        ++pos;
+                        long texIdx = readIndex(pos, token);
+                        if (d_hasTexCoords)
+                            vert.d_tex = toIndex(texIdx, tex);
+                    }
+                    if (pos != token && *pos == '/')
+                    {
+                        ++pos;
+                        vert.d_norm = toIndex(readIndex(pos, token), norm);
+                    }
+                    ok = ok && pos == token;
+                    pos = token;
+                }
+                break;
+            default:
+                break;
+        }
+        if (!ok)
+            ++malformed;
+        pos = last == end ? end : last + 1;
+    }
+    return malformed;
 }
 
-void OBJLoader::parseFace(StringList const &tokens)
+// --- Binary mesh cache ---------------------------------------------
+
+namespace
 {
-    // skip the first token ("f")
-    for (size_t idx = 1; idx < tokens.size(); ++idx)
+    char const MESH_MAGIC[4] = {'R', 'T', 'M', 'C'};
+    uint32_t const MESH_VERSION = 1;
+
+    // The cache file consists of this header followed by the
+    // coordinates, normals, texture coordinates and face vertices,
+    // exactly as they are stored in memory
+    struct MeshHeader
     {
-        // format is:
-        // <vertex idx + 1>/<texture idx +1>/<normal idx + 1>
-        // Wavefront .obj files start counting from 1 (yuck)
+        char magic[4];
+        uint32_t version;
+        FileStamp source;           // the .obj file the cache is of
+        uint64_t numCoords;
+        uint64_t numNormals;
+        uint64_t numTexCoords;
+        uint64_t numVertices;
+        uint32_t hasTexCoords;
+        float boundsMin[3];
+        float boundsMax[3];
+        uint32_t padding;
+    };
+
+    template <typename Type>
+    char const *readArray(char const *ptr, vector<Type> &dest, size_t count)
+    {
+        Type const *first = reinterpret_cast<Type const *>(ptr);
+        dest.assign(first, first + count);
+        return ptr + count * sizeof(Type);
+    }
 
-        StringList elements = split(tokens.at(idx), '/');
-        Vertex_idx vertex {}; // initialize to zeros on all fields
+    template <typename Type>
+    void writeArray(ofstream &out, vector<Type> const &src)
+    {
+        out.write(reinterpret_cast<char const *>(src.data()), src.size() * sizeof(Type));
+    }
+}
 
-        vertex.d_coord = stoul(elements.at(0)) - 1U;
+bool OBJLoader::readCache(string const &filename)
+{
+    MappedFile cache(filename + ".cache");
+    if (!cache.valid() || cache.size() < sizeof(MeshHeader))
+        return false;
+
+    MeshHeader header;
+    memcpy(&header, cache.data(), sizeof(MeshHeader));
+
+    size_t const expected = sizeof(MeshHeader)
+                          + header.numCoords * sizeof(vec3)
+                          + header.numNormals * sizeof(vec3)
+                          + header.numTexCoords * sizeof(vec2)
+                          + header.numVertices * sizeof(Vertex_idx);
+
+    if (memcmp(header.magic, MESH_MAGIC, sizeof(MESH_MAGIC)) != 0
+        || header.version != MESH_VERSION
+        || expected != cache.size()
+        || !header.source.matches(filename))
+        return false;
+
+    // no parsing at all, the arrays are copied from the mapping as is
+    char const *ptr = cache.data() + sizeof(MeshHeader);
+    ptr = readArray(ptr, d_coordinates, header.numCoords);
+    ptr = readArray(ptr, d_normals, header.numNormals);
+    ptr = readArray(ptr, d_texCoords, header.numTexCoords);
+    readArray(ptr, d_vertices, header.numVertices);
+
+    d_hasTexCoords = header.hasTexCoords != 0;
+    d_boundsMin = vec3{header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]};
+    d_boundsMax = vec3{header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]};
+    return true;
+}
 
-        if (d_hasTexCoords)
-            vertex.d_tex = stoul(elements.at(1)) - 1U;
-        else
-            vertex.d_tex = 0U;       // ignored
+bool OBJLoader::writeCache(string const &filename) const
+{
+    MeshHeader header {};
+    memcpy(header.magic, MESH_MAGIC, sizeof(MESH_MAGIC));
+    header.version = MESH_VERSION;
+    if (!header.source.read(filename))
+        return false;
+
+    header.numCoords = d_coordinates.size();
+    header.numNormals = d_normals.size();
+    header.numTexCoords = d_texCoords.size();
+    header.numVertices = d_vertices.size();
+    header.hasTexCoords = d_hasTexCoords;
+    bounds(header.boundsMin, header.boundsMax);
+
+    // write to a temporary file first, so other processes never see a
+    // partially written cache
+    string const cname = filename + ".cache";
+    string const tmpname = cname + ".tmp";
+    {
+        ofstream outfile(tmpname, ios::binary | ios::trunc);
+        if (!outfile)
+            return false;
 
-        vertex.d_norm = stoul(elements.at(2)) - 1U;
+        outfile.write(reinterpret_cast<char const *>(&header), sizeof(MeshHeader));
+        writeArray(outfile, d_coordinates);
+        writeArray(outfile, d_normals);
+        writeArray(outfile, d_texCoords);
+        writeArray(outfile, d_vertices);
 
-        d_vertices.push_back(vertex);
+        if (!outfile)
+        {
+            outfile.close();
+            remove(tmpname.c_str());
+            return false;
+        }
     }
-}
-
-OBJLoader::StringList OBJLoader::split(string const &line,
-                            char splitChar,
-                            bool keepEmpty)
-{
-    StringList tokens;
-    istringstream iss(line);
-    string token;
-    while (getline(iss, token, splitChar))
-        if (token.size() > 0 || (token.size() == 0 && keepEmpty))
-            tokens.push_back(token);
-
-    return tokens;
+    return rename(tmpname.c_str(), cname.c_str()) == 0;
 }
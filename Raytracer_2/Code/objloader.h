@@ -7,6 +7,7 @@
 
 #include "vertex.h"
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -31,6 +32,9 @@ class OBJLoader
     std::vector<vec3> d_normals;
     std::vector<vec2> d_texCoords;
 
+    vec3 d_boundsMin;   // axis aligned bounding box of the coordinates
+    vec3 d_boundsMax;
+
     /**
      * @brief The Vertex struct
      * Contains indices into the above
@@ -39,20 +43,36 @@ class OBJLoader
      */
     struct Vertex_idx
     {
-        size_t d_coord;
-        size_t d_norm;
-        size_t d_tex;
+        uint32_t d_coord;
+        uint32_t d_norm;
+        uint32_t d_tex;
     };
 
     std::vector<Vertex_idx> d_vertices;
 
-    typedef std::vector<std::string> StringList;
+    /**
+     * @brief The LineCounts struct
+     * Number of coordinates, normals, texture coordinates and
+     * face vertices in (a chunk of) the file. Used to size the
+     * storage up front and to give every chunk its own part of it.
+     */
+    struct LineCounts
+    {
+        size_t d_coords;
+        size_t d_norms;
+        size_t d_texs;
+        size_t d_vertices;
+    };
 
     public:
 
         /**
          * @brief OBJLoader
          * @param filename
+         *
+         * Loads the binary cache of the file (filename + ".cache")
+         * when it is up to date. Otherwise the .obj file is parsed
+         * and the cache is (re)written.
          */
         explicit OBJLoader(std::string const &filename);
 
@@ -65,10 +85,23 @@ class OBJLoader
          */
         std::vector<Vertex> vertex_data() const;
 
+        /**
+         * @brief positions
+         * @return only the coordinates of the vertices, x y z for
+         *  every vertex, so 9 floats per triangle. A quarter of the
+         *  memory of vertex_data, for large models.
+         */
+        std::vector<float> positions() const;
+
         unsigned numTriangles() const;
 
         bool hasTexCoords() const;
 
+        /**
+         * @brief bounds: axis aligned bounding box of the model
+         */
+        void bounds(float min[3], float max[3]) const;
+
         /**
          * @brief unitize: scale mesh to fit in unitcube
          *
@@ -78,17 +111,15 @@ class OBJLoader
 
     private:
 
-        void parseFile(std::string const &filename);
-        void parseLine(std::string const &line);
-        void parseVertex(StringList const &tokens);
-        void parseNormal(StringList const &tokens);
-        void parseTexCoord(StringList const &tokens);
-        void parseFace(StringList const &tokens);
+        bool parseFile(std::string const &filename);
+        void computeBounds();
 
-        StringList split(std::string const &str,
-                             char splitChar,
-                             bool keepEmpty = true);
+        bool readCache(std::string const &filename);
+        bool writeCache(std::string const &filename) const;
 
+        static LineCounts countLines(char const *begin, char const *end);
+        size_t parseChunk(char const *begin, char const *end,
+                          LineCounts const &offset);
 };
 
 #endif // OBJLOADER_H_
@@ -0,0 +1,515 @@
+#include "pager.h"
+
+#include "arena.h"
+#include "filestamp.h"
+#include "objloader.h"
+#include "shapes/triangle.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>       // rename, remove
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+
+using namespace std;
+
+namespace
+{
+    char const PAGES_MAGIC[4] = {'R', 'T', 'P', 'G'};
+    uint32_t const PAGES_VERSION = 1;
+
+    unsigned const PAGE_TRIANGLES = 1024;   // at most, about 52 KiB a page
+    unsigned const LEAF_SIZE = 4;           // as in the BVH
+    size_t const PAGE_ALIGN = 4096;         // pages start at system pages
+
+    // The page file consists of this header, a PageEntry per page and the
+    // pages, each on its own system pages
+    struct PagesHeader
+    {
+        char magic[4];
+        uint32_t version;
+        FileStamp source;           // the .obj file the pages are of
+        uint64_t numPages;
+        uint64_t numTriangles;
+    };
+
+    struct PageEntry
+    {
+        float min[3];               // bounding box of the triangles
+        float max[3];
+        uint64_t offset;
+        uint64_t bytes;
+    };
+
+    // A page is this header, the nodes of its BVH and the corners of its
+    // triangles (9 floats each), in leaf order
+    struct PageHeader
+    {
+        uint32_t numNodes;
+        uint32_t numTriangles;
+    };
+
+    struct PageNode
+    {
+        float min[3];
+        float max[3];
+        uint32_t right;             // index of right child, left is next node
+        uint16_t first;             // leaves: range of triangles
+        uint16_t count;             // 0 for inner nodes
+    };
+
+    // The positions of the triangles order[first, last) split at the
+    // median of their centres along the longest axis, as in BVH::build.
+    // Returns the middle.
+    unsigned split(vector<float> const &positions, vector<uint32_t> &order,
+                   unsigned first, unsigned last, float min[3], float max[3])
+    {
+        float centreMin[3];
+        float centreMax[3];
+        for (int axis = 0; axis != 3; ++axis)
+        {
+            min[axis] = centreMin[axis] = numeric_limits<float>::infinity();
+            max[axis] = centreMax[axis] = -numeric_limits<float>::infinity();
+        }
+        for (unsigned pos = first; pos != last; ++pos)
+        {
+            float const *corners = &positions[9 * size_t(order[pos])];
+            for (int axis = 0; axis != 3; ++axis)
+            {
+                float lo = std::min({corners[axis], corners[3 + axis], corners[6 + axis]});
+                float hi = std::max({corners[axis], corners[3 + axis], corners[6 + axis]});
+                min[axis] = std::min(min[axis], lo);
+                max[axis] = std::max(max[axis], hi);
+                centreMin[axis] = std::min(centreMin[axis], lo + hi);
+                centreMax[axis] = std::max(centreMax[axis], lo + hi);
+            }
+        }
+
+        int axis = 0;
+        for (int other = 1; other != 3; ++other)
+        {
+            if (centreMax[other] - centreMin[other] > centreMax[axis] - centreMin[axis])
+                axis = other;
+        }
+
+        unsigned middle = first + (last - first) / 2;
+        auto centre = [&](uint32_t idx)
+        {
+            float const *corners = &positions[9 * size_t(idx)];
+            return std::min({corners[axis], corners[3 + axis], corners[6 + axis]})
+                 + std::max({corners[axis], corners[3 + axis], corners[6 + axis]});
+        };
+        nth_element(order.begin() + first, order.begin() + middle, order.begin() + last,
+                    [&](uint32_t lhs, uint32_t rhs)
+                    {
+                        return centre(lhs) < centre(rhs);
+                    });
+        return middle;
+    }
+
+    // cuts the triangles order[first, last) into pages, the ranges of
+    // which are appended to pages
+    void cut(vector<float> const &positions, vector<uint32_t> &order, unsigned first,
+             unsigned last, vector<pair<unsigned, unsigned>> &pages)
+    {
+        if (last - first <= PAGE_TRIANGLES)
+        {
+            pages.push_back(make_pair(first, last));
+            return;
+        }
+
+        float min[3];
+        float max[3];
+        unsigned middle = split(positions, order, first, last, min, max);
+        cut(positions, order, first, middle, pages);
+        cut(positions, order, middle, last, pages);
+    }
+
+    // BVH of the triangles order[first, last) of a page, whose first
+    // triangle is at pageFirst
+    unsigned buildNodes(vector<float> const &positions, vector<uint32_t> &order,
+                        unsigned pageFirst, unsigned first, unsigned last,
+                        vector<PageNode> &nodes)
+    {
+        unsigned nodeIdx = nodes.size();
+        nodes.push_back(PageNode());
+
+        PageNode node {};
+        if (last - first <= LEAF_SIZE)
+        {
+            split(positions, order, first, last, node.min, node.max);
+            node.first = first - pageFirst;
+            node.count = last - first;
+        }
+        else
+        {
+            unsigned middle = split(positions, order, first, last, node.min, node.max);
+            buildNodes(positions, order, pageFirst, first, middle, nodes);
+            node.right = buildNodes(positions, order, pageFirst, middle, last, nodes);
+        }
+
+        nodes[nodeIdx] = node;
+        return nodeIdx;
+    }
+
+    // slab test as in the Grid, true if the ray passes the box before tMax
+    bool hitsBox(PageNode const &node, Ray const &ray, Vector const &invD, double tMax,
+                 double &tEntry)
+    {
+        double tNear = 0.0;
+        double tFar = tMax;
+        for (int axis = 0; axis != 3; ++axis)
+        {
+            double t1 = (node.min[axis] - ray.O.data[axis]) * invD.data[axis];
+            double t2 = (node.max[axis] - ray.O.data[axis]) * invD.data[axis];
+            if (t1 > t2)
+                swap(t1, t2);
+            tNear = t1 > tNear ? t1 : tNear;
+            tFar = t2 < tFar ? t2 : tFar;
+            if (tNear > tFar)
+                return false;
+        }
+        tEntry = tNear;
+        return true;
+    }
+
+    Triangle triangle(float const *corners)
+    {
+        return Triangle(Point(corners[0], corners[1], corners[2]),
+                        Point(corners[3], corners[4], corners[5]),
+                        Point(corners[6], corners[7], corners[8]));
+    }
+}
+
+Pager::Pager(size_t budget)
+:
+    d_budget(budget),
+    d_clock(0)
+{}
+
+vector<ObjectPtr> Pager::load(string const &model, Arena &arena)
+{
+    string const name = pagesName(model);
+    unique_ptr<MappedFile> file;
+    PagesHeader header;
+    for (int attempt = 0; attempt != 2; ++attempt)
+    {
+        // the second time round the file has just been written
+        if (attempt != 0 && !writeFile(model))
+            throw runtime_error("Could not write the pages of " + model + " to " + name);
+
+        file.reset(new MappedFile(name));
+        if (!file->valid() || file->size() < sizeof(PagesHeader))
+            continue;
+
+        memcpy(&header, file->data(), sizeof(PagesHeader));
+        if (memcmp(header.magic, PAGES_MAGIC, sizeof(PAGES_MAGIC)) == 0
+            && header.version == PAGES_VERSION
+            && sizeof(PagesHeader) + header.numPages * sizeof(PageEntry) <= file->size()
+            && header.source.matches(model))
+            break;
+        file.reset();
+    }
+    if (!file)
+        throw runtime_error("Invalid page file " + name);
+
+    vector<ObjectPtr> pages;
+    for (size_t idx = 0; idx != header.numPages; ++idx)
+    {
+        PageEntry entry;
+        memcpy(&entry, file->data() + sizeof(PagesHeader) + idx * sizeof(PageEntry),
+               sizeof(PageEntry));
+        if (entry.offset % PAGE_ALIGN != 0 || entry.offset + entry.bytes > file->size())
+            throw runtime_error("Invalid page file " + name);
+
+        d_pages.emplace_back();
+        Page &page = d_pages.back();
+        page.file = file.get();
+        page.offset = entry.offset;
+        page.bytes = entry.bytes;
+        page.lastUse = 0;
+        page.resident = false;
+        pages.push_back(arena.create<MeshPage>(*this, d_pages.size() - 1,
+                                               Point(entry.min[0], entry.min[1], entry.min[2]),
+                                               Point(entry.max[0], entry.max[1], entry.max[2])));
+    }
+    d_files.push_back(move(file));
+    return pages;
+}
+
+char const *Pager::use(unsigned idx)
+{
+    Page &page = d_pages[idx];
+    uint64_t now = d_clock.load(memory_order_relaxed);
+    if (page.lastUse.load(memory_order_relaxed) != now)
+        page.lastUse.store(now, memory_order_relaxed);
+
+    if (!page.resident.load(memory_order_acquire))
+    {
+        lock_guard<mutex> lock(d_mutex);
+        if (!page.resident.load(memory_order_relaxed))
+        {
+            // read in at once instead of a fault per system page
+            page.file->prefetch(page.offset, page.bytes);
+            page.lastUse.store(d_clock.fetch_add(1, memory_order_relaxed) + 1,
+                               memory_order_relaxed);
+            page.resident.store(true, memory_order_release);
+            d_resident.push_back(idx);
+            d_residentBytes += page.bytes;
+            ++d_numLoads;
+            evict();
+            d_peakBytes = max(d_peakBytes, d_residentBytes);
+        }
+    }
+    return page.file->data() + page.offset;
+}
+
+size_t Pager::numPages() const
+{
+    return d_pages.size();
+}
+
+size_t Pager::numLoads() const
+{
+    return d_numLoads;
+}
+
+size_t Pager::numEvictions() const
+{
+    return d_numEvictions;
+}
+
+size_t Pager::peakBytes() const
+{
+    return d_peakBytes;
+}
+
+// --- Private -----------------------------------------------------------------
+
+// Drops the least recently used pages until the rest fits in the budget.
+// The page read in last is kept, even if it does not fit by itself.
+void Pager::evict()
+{
+    while (d_residentBytes > d_budget && d_resident.size() > 1)
+    {
+        size_t oldest = 0;
+        for (size_t pos = 1; pos != d_resident.size() - 1; ++pos)
+        {
+            if (d_pages[d_resident[pos]].lastUse.load(memory_order_relaxed)
+                < d_pages[d_resident[oldest]].lastUse.load(memory_order_relaxed))
+                oldest = pos;
+        }
+
+        Page &page = d_pages[d_resident[oldest]];
+        page.resident.store(false, memory_order_relaxed);
+        page.file->release(page.offset, page.bytes);
+        d_residentBytes -= page.bytes;
+        d_resident[oldest] = d_resident.back();
+        d_resident.pop_back();
+        ++d_numEvictions;
+    }
+}
+
+string Pager::pagesName(string const &model)
+{
+    return model + ".pages";
+}
+
+// Cuts the triangles of the model into pages along a BVH and writes them.
+// Only the corners of the triangles are loaded, not Triangle objects.
+bool Pager::writeFile(string const &model)
+{
+    PagesHeader header {};
+    memcpy(header.magic, PAGES_MAGIC, sizeof(PAGES_MAGIC));
+    header.version = PAGES_VERSION;
+    if (!header.source.read(model))
+        return false;
+
+    vector<float> positions = OBJLoader(model).positions();
+    vector<uint32_t> order(positions.size() / 9);
+    iota(order.begin(), order.end(), 0);
+    if (order.empty())
+        return false;
+
+    vector<pair<unsigned, unsigned>> ranges;
+    cut(positions, order, 0, order.size(), ranges);
+    header.numPages = ranges.size();
+    header.numTriangles = order.size();
+
+    // write to a temporary file first, so other processes never see a
+    // partially written page file. The entries are known once the pages
+    // are written, so they are written last.
+    string const name = pagesName(model);
+    string const tmpname = name + ".tmp";
+    {
+        ofstream outfile(tmpname, ios::binary | ios::trunc);
+        if (!outfile)
+            return false;
+
+        vector<PageEntry> entries(ranges.size());
+        size_t offset = sizeof(PagesHeader) + entries.size() * sizeof(PageEntry);
+        for (size_t idx = 0; idx != ranges.size(); ++idx)
+        {
+            unsigned first = ranges[idx].first;
+            unsigned last = ranges[idx].second;
+            vector<PageNode> nodes;
+            buildNodes(positions, order, first, first, last, nodes);
+
+            vector<float> corners;
+            for (unsigned pos = first; pos != last; ++pos)
+            {
+                float const *triangle = &positions[9 * size_t(order[pos])];
+                corners.insert(corners.end(), triangle, triangle + 9);
+            }
+
+            PageHeader page {static_cast<uint32_t>(nodes.size()), last - first};
+            offset = (offset + PAGE_ALIGN - 1) / PAGE_ALIGN * PAGE_ALIGN;
+            outfile.seekp(offset);
+            outfile.write(reinterpret_cast<char const *>(&page), sizeof(PageHeader));
+            outfile.write(reinterpret_cast<char const *>(nodes.data()),
+                          nodes.size() * sizeof(PageNode));
+            outfile.write(reinterpret_cast<char const *>(corners.data()),
+                          corners.size() * sizeof(float));
+
+            PageEntry &entry = entries[idx];
+            copy(nodes[0].min, nodes[0].min + 3, entry.min);
+            copy(nodes[0].max, nodes[0].max + 3, entry.max);
+            entry.offset = offset;
+            entry.bytes = sizeof(PageHeader) + nodes.size() * sizeof(PageNode)
+                        + corners.size() * sizeof(float);
+            offset += entry.bytes;
+        }
+
+        outfile.seekp(0);
+        outfile.write(reinterpret_cast<char const *>(&header), sizeof(PagesHeader));
+        outfile.write(reinterpret_cast<char const *>(entries.data()),
+                      entries.size() * sizeof(PageEntry));
+
+        if (!outfile)
+        {
+            outfile.close();
+            remove(tmpname.c_str());
+            return false;
+        }
+    }
+    return rename(tmpname.c_str(), name.c_str()) == 0;
+}
+
+// --- MeshPage ----------------------------------------------------------------
+
+MeshPage::MeshPage(Pager &pager, unsigned page, Point const &min, Point const &max)
+:
+    d_pager(pager),
+    d_page(page),
+    d_min(min),
+    d_max(max)
+{}
+
+Hit MeshPage::intersect(Ray const &ray)
+{
+    Hit hit;
+    distance(ray, hit);
+    if (isnan(hit.t))
+        return Hit::NO_HIT();
+    attributes(ray, hit);
+    return hit;
+}
+
+// the closest triangle of the page, walking its BVH as BVH::closest does
+void MeshPage::distance(Ray const &ray, Hit &hit)
+{
+    char const *data = d_pager.use(d_page);
+    PageHeader header;
+    memcpy(&header, data, sizeof(PageHeader));
+    PageNode const *nodes = reinterpret_cast<PageNode const *>(data + sizeof(PageHeader));
+    float const *corners = reinterpret_cast<float const *>(nodes + header.numNodes);
+
+    hit.t = numeric_limits<double>::infinity();
+    int closest = -1;
+
+    Vector invD(1.0 / ray.D.x, 1.0 / ray.D.y, 1.0 / ray.D.z);
+    unsigned stack[64];
+    double stackT[64];
+    unsigned size = 0;
+    double tRoot;
+    if (hitsBox(nodes[0], ray, invD, hit.t, tRoot))
+    {
+        stack[size] = 0;
+        stackT[size++] = tRoot;
+    }
+    while (size != 0)
+    {
+        --size;
+        if (stackT[size] > hit.t)
+            continue;
+
+        PageNode const &node = nodes[stack[size]];
+        if (node.count != 0)
+        {
+            for (unsigned idx = node.first; idx != node.first + node.count; ++idx)
+            {
+                Hit triHit;
+                triangle(corners + 9 * idx).distance(ray, triHit);
+                if ((triHit.t < hit.t || (triHit.t == hit.t && static_cast<int>(idx) < closest))
+                    && triHit.t > 0)
+                {
+                    hit = triHit;
+                    closest = idx;
+                }
+            }
+            continue;
+        }
+
+        unsigned near = stack[size] + 1;
+        unsigned far = node.right;
+        double tNear;
+        double tFar;
+        bool hitNear = hitsBox(nodes[near], ray, invD, hit.t, tNear);
+        bool hitFar = hitsBox(nodes[far], ray, invD, hit.t, tFar);
+        if (hitNear && hitFar && tFar < tNear)
+        {
+            swap(near, far);
+            swap(tNear, tFar);
+        }
+        if (hitFar)
+        {
+            stack[size] = far;
+            stackT[size++] = tFar;
+        }
+        if (hitNear)
+        {
+            stack[size] = near;
+            stackT[size++] = tNear;
+        }
+    }
+
+    if (closest < 0)
+        hit.t = numeric_limits<double>::quiet_NaN();
+    hit.primitive = closest < 0 ? 0 : closest;
+}
+
+void MeshPage::attributes(Ray const &ray, Hit &hit)
+{
+    char const *data = d_pager.use(d_page);
+    PageHeader header;
+    memcpy(&header, data, sizeof(PageHeader));
+    float const *corners = reinterpret_cast<float const *>(
+        data + sizeof(PageHeader) + header.numNodes * sizeof(PageNode));
+    triangle(corners + 9 * hit.primitive).attributes(ray, hit);
+}
+
+std::tuple<float, float> MeshPage::pointMapping(Triple p)
+{
+    // the mapping of triangles does not depend on their corners
+    return Triangle(Point(), Point(), Point()).pointMapping(p);
+}
+
+bool MeshPage::bounds(Point &min, Point &max)
+{
+    min = d_min;
+    max = d_max;
+    return true;
+}
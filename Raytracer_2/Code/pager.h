@@ -0,0 +1,107 @@
+#ifndef PAGER_H_
+#define PAGER_H_
+
+#include "mappedfile.h"
+#include "object.h"
+#include "triple.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// Forward declerations
+class Arena;
+
+/**
+ * Out of core triangle meshes, for models that do not fit in memory as
+ * Triangle objects (scene option "GeometryBudget"). The triangles of a
+ * model are stored in a page file next to it (<model>.pages), cut along a
+ * BVH into pages of nearby triangles, each with the part of the BVH
+ * within it. The file is memory mapped and only the boxes of the pages
+ * are kept in memory, as MeshPage objects: the BVH of the geometry is
+ * built over those. A page is read in when a ray first enters its box,
+ * and the least recently used pages are dropped again once the pages in
+ * memory exceed the budget.
+ */
+class Pager
+{
+    struct Page
+    {
+        MappedFile const *file;
+        size_t offset;                  // of the page in the file
+        size_t bytes;
+        std::atomic<uint64_t> lastUse;  // d_clock when last used
+        std::atomic<bool> resident;
+    };
+
+    size_t d_budget;                    // bytes
+    std::vector<std::unique_ptr<MappedFile>> d_files;
+    std::deque<Page> d_pages;           // of all files
+
+    // the pages in memory and their bytes. A page may be dropped while
+    // another thread uses it, which only makes the system read it again.
+    std::mutex d_mutex;
+    std::vector<unsigned> d_resident;
+    size_t d_residentBytes = 0;
+    std::atomic<uint64_t> d_clock;      // advances with every page read in
+
+    size_t d_numLoads = 0;
+    size_t d_numEvictions = 0;
+    size_t d_peakBytes = 0;
+
+    public:
+
+        explicit Pager(size_t budget);
+
+        Pager(Pager const &other) = delete;
+        Pager &operator=(Pager const &other) = delete;
+
+        // maps the page file of the model, writing it first if it is
+        // missing or outdated, and creates a MeshPage in the arena for
+        // every page. Throws runtime_error if the model can not be read.
+        std::vector<ObjectPtr> load(std::string const &model, Arena &arena);
+
+        // the data of the page, read in (within the budget) if needed
+        char const *use(unsigned page);
+
+        size_t numPages() const;
+        size_t numLoads() const;        // pages read in, including again
+        size_t numEvictions() const;
+        size_t peakBytes() const;       // most bytes in memory at once
+
+    private:
+
+        void evict();                   // d_mutex must be held
+
+        static std::string pagesName(std::string const &model);
+        static bool writeFile(std::string const &model);
+};
+
+/**
+ * The triangles of a page of a Pager, as one object. The hit primitive is
+ * the triangle within the page.
+ */
+class MeshPage: public Object
+{
+    Pager &d_pager;
+    unsigned d_page;
+    Point d_min;
+    Point d_max;
+
+    public:
+        MeshPage(Pager &pager, unsigned page, Point const &min, Point const &max);
+
+        virtual Hit intersect(Ray const &ray);
+        virtual void distance(Ray const &ray, Hit &hit);
+        virtual void attributes(Ray const &ray, Hit &hit);
+        virtual std::tuple<float, float> pointMapping(Triple p);
+        virtual bool bounds(Point &min, Point &max);
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef RANDOM_H_
+#define RANDOM_H_
+
+#include <cstdint>
+
+/**
+ * Small and fast pseudo random number generator (PCG32). Every pixel
+ * sample seeds its own generator from its coordinates, so the random
+ * numbers do not depend on the order in which threads render pixels.
+ */
+class Random
+{
+    uint64_t d_state;
+
+    public:
+
+        explicit Random(uint64_t seed)
+        :
+            d_state(mix(seed))
+        {}
+
+        // generator for sample 'sample' of pixel (x, y)
+        Random(unsigned x, unsigned y, unsigned sample)
+        :
+            Random((static_cast<uint64_t>(y) << 40) ^ (static_cast<uint64_t>(x) << 20) ^ sample)
+        {}
+
+        uint32_t next()
+        {
+            uint64_t old = d_state;
+            d_state = old * 6364136223846793005ULL + 1442695040888963407ULL;
+            uint32_t xorshifted = ((old >> 18u) ^ old) >> 27u;
+            uint32_t rot = old >> 59u;
+            return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+        }
+
+        // uniformly distributed in [0, 1)
+        double uniform()
+        {
+            return next() * (1.0 / 4294967296.0);
+        }
+
+    private:
+
+        // splitmix64 finalizer, spreads similar seeds over the state space
+        static uint64_t mix(uint64_t value)
+        {
+            value += 0x9e3779b97f4a7c15ULL;
+            value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+            return value ^ (value >> 31);
+        }
+};
+
+#endif
@@ -1,8 +1,17 @@
 #include "raytracer.h"
 
+#include "bvh.h"
+#include "checkpoint.h"
+#include "denoiser.h"
+#include "distributed.h"
+#include "filestamp.h"
 #include "image.h"
 #include "light.h"
 #include "material.h"
+#include "objloader.h"
+#include "pager.h"
+#include "scenecache.h"
+#include "scenestream.h"
 #include "triple.h"
 #include <tuple>
 
@@ -14,6 +23,7 @@
 #include "shapes/triangle.h"
 #include "shapes/plane.h"
 #include "shapes/quad.h"
+#include "shapes/instance.h"
 
 // =============================================================================
 // -- End of shape includes ----------------------------------------------------
@@ -22,162 +32,650 @@
 #include "json/json.h"
 
 #include <exception>
-#include <fstream>
 #include <iostream>
 
 using namespace std;        // no std:: required
 using json = nlohmann::json;
 
-bool Raytracer::parseObjectNode(json const &node, string const &ifname)
+namespace
 {
-    ObjectPtr obj = nullptr;
+    void store(Triple const &triple, double *dest)
+    {
+        dest[0] = triple.x;
+        dest[1] = triple.y;
+        dest[2] = triple.z;
+    }
+
+    Triple load(double const *src)
+    {
+        return Triple(src[0], src[1], src[2]);
+    }
+
+    // FNV-1a hash of raw bytes, continuing from hash
+    uint64_t hashBytes(void const *data, size_t size, uint64_t hash)
+    {
+        unsigned char const *bytes = static_cast<unsigned char const *>(data);
+        for (size_t idx = 0; idx != size; ++idx)
+        {
+            hash ^= bytes[idx];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    // files (textures, models) are looked up in the directory of the scene
+    string scenePath(string const &ifname, string const &file)
+    {
+        string path = ifname;
+        path.erase(path.begin() + path.find_last_of('/'), path.end());
+        return path + "/" + file;
+    }
+}
+
+void Raytracer::parseScene(string const &ifname, SceneDescription &desc) const
+{
+    // Stream the input json file: the (possibly huge) "Objects" array is
+    // parsed a batch of objects at a time, instead of building the DOM of
+    // the whole file first
+    SceneStream stream(ifname);
+    string settings;
+
+    auto onMember = [&](string const &key, string const &value)
+    {
+        if (key == "Geometries")
+            parseGeometries(json::parse(value), ifname, desc);
+        else
+            settings += (settings.empty() ? "{" : ",") + json(key).dump() + ":" + value;
+    };
+
+    auto onObjects = [&](vector<string> const &texts)
+    {
+        // the JSON nodes of a batch are independent, so they can be parsed
+        // in parallel. Building the records is cheap and done in order.
+        vector<json> nodes(texts.size());
+        string error;
+
+        #pragma omp parallel for schedule(dynamic, 64)
+        for (size_t idx = 0; idx < texts.size(); ++idx)
+        {
+            try
+            {
+                nodes[idx] = json::parse(texts[idx]);
+            }
+            catch (exception const &ex)
+            {
+                #pragma omp critical
+                error = ex.what();
+            }
+        }
+        if (!error.empty())
+            throw runtime_error(error);
+
+        for (json const &node : nodes)
+            parseObjectNode(node, ifname, desc);
+    };
+
+    stream.parse(onMember, onObjects);
+    desc.resolveInstances();
+
+    json jsonscene = json::parse(settings.empty() ? string("{}") : settings + "}");
+
+    for (auto const &lightNode : jsonscene["Lights"])
+        desc.lights.push_back(parseLightNode(lightNode));
+
+    // everything else are settings, which are kept as (small) JSON text
+    jsonscene.erase("Lights");
+    desc.settings = jsonscene.dump();
+}
+
+bool Raytracer::parseObjectNode(json const &node, string const &ifname,
+                                SceneDescription &desc) const
+{
+    ObjectRecord record {};
+    if (!parseShapeNode(node, record, desc))
+        return false;
+
+    // Parse material and add object to the scene. Instances may leave it
+    // out and use the material of their geometry.
+    if (record.type == OBJECT_INSTANCE && node.find("material") == node.end())
+        record.material = GEOMETRY_MATERIAL;
+    else
+        record.material = desc.addMaterial(parseMaterialNode(node["material"], ifname, desc));
+    desc.objects.push_back(record);
+    return true;
+}
+
+bool Raytracer::parseShapeNode(json const &node, ObjectRecord &record,
+                               SceneDescription &desc) const
+{
+    string const type = node["type"];
 
 // =============================================================================
 // -- Determine type and parse object parametrers ------------------------------
 // =============================================================================
 
-    if (node["type"] == "sphere")
+    if (type == "sphere")
     {
-        Point pos(node["position"]);
-        double radius = node["radius"];
-        float angle = 0.0;
+        record.type = OBJECT_SPHERE;
+        store(Point(node["position"]), record.params);
+        record.params[3] = node["radius"];
+        store(Point(1.0, 0.0, 0.0), record.params + 4);
+        record.params[7] = 0.0;
 
         auto angleStatus = node.find("angle");
         if (angleStatus != node.end()) {
-            angle = node["angle"];
+            record.params[7] = static_cast<float>(*angleStatus);
         }
         auto rotationStatus = node.find("rotation");
         if (rotationStatus != node.end()) {
-            Point rotation(node["rotation"]);
-            obj = ObjectPtr(new Sphere(pos, radius, rotation, angle));
-        } else {
-            obj = ObjectPtr(new Sphere(pos, radius, Point(1.0,0.0,0.0), angle));
+            store(Point(*rotationStatus), record.params + 4);
         }
-
-    } else if (node["type"] == "triangle") {
-        Point vertex1(node["vertex1"]);
-        Point vertex2(node["vertex2"]);
-        Point vertex3(node["vertex3"]);
-        obj = ObjectPtr(new Triangle(vertex1, vertex2, vertex3));
-    } else if(node["type"] == "plane") {
-        float a(node["a"]);
-        float b(node["b"]);
-        float c(node["c"]);
-        float d(node["d"]);
-        obj = ObjectPtr(new Plane(a, b, c, d));
-    } else if(node["type"] == "quad") {
-        Point vertex1(node["vertex1"]);
-        Point vertex2(node["vertex2"]);
-        Point vertex3(node["vertex3"]);
-        Point vertex4(node["vertex4"]);
-        obj = ObjectPtr(new Quad(vertex1, vertex2, vertex3, vertex4));
+    } else if (type == "triangle") {
+        record.type = OBJECT_TRIANGLE;
+        store(Point(node["vertex1"]), record.params);
+        store(Point(node["vertex2"]), record.params + 3);
+        store(Point(node["vertex3"]), record.params + 6);
+    } else if(type == "plane") {
+        record.type = OBJECT_PLANE;
+        record.params[0] = static_cast<float>(node["a"]);
+        record.params[1] = static_cast<float>(node["b"]);
+        record.params[2] = static_cast<float>(node["c"]);
+        record.params[3] = static_cast<float>(node["d"]);
+    } else if(type == "quad") {
+        record.type = OBJECT_QUAD;
+        store(Point(node["vertex1"]), record.params);
+        store(Point(node["vertex2"]), record.params + 3);
+        store(Point(node["vertex3"]), record.params + 6);
+        store(Point(node["vertex4"]), record.params + 9);
+    } else if(type == "instance") {
+        record.type = OBJECT_INSTANCE;
+        record.geometry = desc.geometryIndex(node["geometry"]);
+        parseTransform(node, record.params);
     }
     else
     {
         cerr << "Unknown object type: " << node["type"] << ".\n";
+        return false;
     }
 
 // =============================================================================
 // -- End of object reading ----------------------------------------------------
 // =============================================================================
 
-    if (!obj)
-        return false;
-
-    // Parse material and add object to the scene
-    obj->material = parseMaterialNode(node["material"], ifname);
-    scene.addObject(obj);
     return true;
 }
 
-Light Raytracer::parseLightNode(json const &node) const
+void Raytracer::parseTransform(json const &node, double *matrix) const
+{
+    //try to find "transform", a 4x4 matrix (nested rows or 16 numbers in
+    //row order), else use the identity
+    double const identity[12] = {1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0};
+    copy(identity, identity + 12, matrix);
+
+    auto transformStatus = node.find("transform");
+    if (transformStatus == node.end())
+        return;
+
+    vector<double> values;
+    for (auto const &entry : *transformStatus)
+    {
+        if (entry.is_array()) {
+            for (auto const &value : entry)
+                values.push_back(value);
+        } else {
+            values.push_back(entry);
+        }
+    }
+
+    if (values.size() != 16)
+        throw runtime_error("An instance transform needs 16 values");
+    if (values[12] != 0 || values[13] != 0 || values[14] != 0 || values[15] != 1)
+        throw runtime_error("An instance transform must be affine (last row 0 0 0 1)");
+    copy(values.begin(), values.begin() + 12, matrix);
+}
+
+void Raytracer::parseGeometries(json const &node, string const &ifname,
+                                SceneDescription &desc) const
+{
+    for (auto entry = node.begin(); entry != node.end(); ++entry)
+    {
+        json const &geometryNode = entry.value();
+        GeometryRecord geometry {};
+        geometry.firstObject = desc.geometryObjects.size();
+        geometry.model = -1;
+        geometry.material = -1;
+
+        auto objectsStatus = geometryNode.find("objects");
+        if (objectsStatus != geometryNode.end()) {
+            for (auto const &objectNode : *objectsStatus) {
+                ObjectRecord record {};
+                if (!parseShapeNode(objectNode, record, desc))
+                    continue;
+                if (record.type == OBJECT_INSTANCE)
+                    throw runtime_error("Geometry " + entry.key() + " contains an instance");
+                desc.geometryObjects.push_back(record);
+            }
+        }
+        geometry.numObjects = desc.geometryObjects.size() - geometry.firstObject;
+
+        auto modelStatus = geometryNode.find("model");
+        if (modelStatus != geometryNode.end()) {
+            desc.models.push_back(scenePath(ifname, *modelStatus));
+            geometry.model = desc.models.size() - 1;
+        }
+
+        auto materialStatus = geometryNode.find("material");
+        if (materialStatus != geometryNode.end())
+            geometry.material = desc.addMaterial(parseMaterialNode(*materialStatus, ifname, desc));
+
+        if (geometry.numObjects == 0 && geometry.model < 0)
+            throw runtime_error("Geometry " + entry.key() + " has no objects or model");
+        desc.defineGeometry(entry.key(), geometry);
+    }
+}
+
+LightRecord Raytracer::parseLightNode(json const &node) const
 {
-    Point pos(node["position"]);
-    Color col(node["color"]);
-    return Light(pos, col);
+    LightRecord record {};      // zero initialized, a point light
+    store(Point(node["position"]), record.position);
+    store(Color(node["color"]), record.color);
+    record.shape = Light::POINT;
+    record.samples = 1;
+
+    //area lights: a "rectangle" with two "edges" around the position, or
+    //a "sphere" with a "radius", soft shadows with up to "samples" rays
+    auto typeStatus = node.find("type");
+    if (typeStatus == node.end())
+        return record;
+
+    string const type = *typeStatus;
+    if (type == "rectangle") {
+        auto const &edges = node.at("edges");
+        if (edges.size() != 2)
+            throw runtime_error("A rectangle light needs 2 edges");
+        record.shape = Light::RECTANGLE;
+        store(Vector(edges[0]), record.edge1);
+        store(Vector(edges[1]), record.edge2);
+    } else if (type == "sphere") {
+        record.shape = Light::SPHERE;
+        record.radius = node.at("radius");
+    } else if (type != "point") {
+        throw runtime_error("Unknown light type: " + type);
+    }
+
+    if (record.shape != Light::POINT) {
+        int samples = node.value("samples", 16);
+        if (samples < 1)
+            throw runtime_error("A light needs at least 1 sample");
+        record.samples = samples;
+    }
+    return record;
 }
 
-Material Raytracer::parseMaterialNode(json const &node, string const &ifname) const
+MaterialRecord Raytracer::parseMaterialNode(json const &node, string const &ifname,
+                                            SceneDescription &desc) const
 {
-    double ka = node["ka"];
-    double kd = node["kd"];
-    double ks = node["ks"];
-    double n  = node["n"];
+    MaterialRecord record {};   // zero initialized, also the padding
+    record.ka = node["ka"];
+    record.kd = node["kd"];
+    record.ks = node["ks"];
+    record.n  = node["n"];
+    record.texture = -1;
 
     //find out to parse either a color or a texture
     auto colorStatus = node.find("color");
     if (colorStatus != node.end()) {
-        Color color(node["color"]);
-        return Material(color, ka, kd, ks, n, false);
+        store(Color(*colorStatus), record.color);
+        return record;
     }
 
     auto textureStatus = node.find("texture");
     if (textureStatus != node.end()) {
-        string s = node["texture"];
-        //find right directory for texture file
-        string ofname = ifname;
-        // replace image file with texture file
-        ofname.erase(ofname.begin() + ofname.find_last_of('/'), ofname.end());
-        ofname += "/" + s;
-        Image im(ofname);
-        return Material(im, ka, kd, ks, n, true);
+        string s = *textureStatus;
+        //the texture file is in the directory of the scene
+        record.texture = desc.addTexture(scenePath(ifname, s));
     }
 
-    return Material(Color(), ka, kd, ks, n, false);
+    return record;
 }
 
-bool Raytracer::readScene(string const &ifname)
-try
+void Raytracer::parseSettings(json const &settings, string const &ifname)
 {
-    // Read and parse input json file
-    ifstream infile(ifname);
-    if (!infile) throw runtime_error("Could not open input file for reading.");
-    json jsonscene;
-    infile >> jsonscene;
-
-// =============================================================================
-// -- Read your scene data in this section -------------------------------------
-// =============================================================================
-
     //try to find "Shadows", else set it to false
-    auto shadowStatus = jsonscene.find("Shadows");
-    if (shadowStatus != jsonscene.end()) {
-        bool shadow(jsonscene["Shadows"]);
+    auto shadowStatus = settings.find("Shadows");
+    if (shadowStatus != settings.end()) {
+        bool shadow(*shadowStatus);
         scene.setShadow(shadow);
     } else {
         scene.setShadow(false);
     }
 
     //try to find "MaxRecursionDepth", else set it to zero
-    auto maxrecdepthStatus = jsonscene.find("MaxRecursionDepth");
-    if (maxrecdepthStatus != jsonscene.end()) {
-        int maxRecursionDepth(jsonscene["MaxRecursionDepth"]);
+    auto maxrecdepthStatus = settings.find("MaxRecursionDepth");
+    if (maxrecdepthStatus != settings.end()) {
+        int maxRecursionDepth(*maxrecdepthStatus);
         scene.setMaxRecursionDepth(maxRecursionDepth);
     } else {
         scene.setMaxRecursionDepth(0);
     }
 
+    //try to find "ReflectionThreshold", else stop reflecting once the
+    //reflection adds less than one 8-bit color step
+    auto thresholdStatus = settings.find("ReflectionThreshold");
+    if (thresholdStatus != settings.end()) {
+        double threshold(*thresholdStatus);
+        scene.setReflectionThreshold(threshold);
+    } else {
+        scene.setReflectionThreshold(1.0 / 256);
+    }
+
+    //try to find "RussianRoulette", else set it to false
+    auto rouletteStatus = settings.find("RussianRoulette");
+    if (rouletteStatus != settings.end()) {
+        bool roulette(*rouletteStatus);
+        scene.setRussianRoulette(roulette);
+    } else {
+        scene.setRussianRoulette(false);
+    }
+
     //try to find "SuperSamplingFactor", else set it to 1
-    auto superSamplingStatus = jsonscene.find("SuperSamplingFactor");
-    if (superSamplingStatus != jsonscene.end()) {
-        int superSampling(jsonscene["SuperSamplingFactor"]);
-        scene.setSuperSampling(superSampling);
+    unsigned samples = 1;
+    auto superSamplingStatus = settings.find("SuperSamplingFactor");
+    if (superSamplingStatus != settings.end()) {
+        int superSampling(*superSamplingStatus);
+        if (superSampling < 1)
+            throw runtime_error("SuperSamplingFactor must be at least 1");
+        samples = superSampling * superSampling;
+    }
+
+    //try to find "SamplesPerPixel", else use SuperSamplingFactor^2
+    auto samplesStatus = settings.find("SamplesPerPixel");
+    if (samplesStatus != settings.end()) {
+        int samplesPerPixel(*samplesStatus);
+        if (samplesPerPixel < 1)
+            throw runtime_error("SamplesPerPixel must be at least 1");
+        samples = samplesPerPixel;
+    }
+
+    //try to find "Sampler", else use a regular grid
+    Sampler::Pattern pattern = Sampler::GRID;
+    auto samplerStatus = settings.find("Sampler");
+    if (samplerStatus != settings.end()) {
+        string const name = *samplerStatus;
+        if (!Sampler::pattern(name, pattern))
+            throw runtime_error("Unknown sampler: " + name);
+    }
+    scene.setSampler(Sampler(pattern, samples));
+
+    //try to find "Filter" and "FilterRadius", else average the samples
+    Filter::Type filterType = Filter::BOX;
+    auto filterStatus = settings.find("Filter");
+    if (filterStatus != settings.end()) {
+        string const name = *filterStatus;
+        if (!Filter::type(name, filterType))
+            throw runtime_error("Unknown filter: " + name);
+    }
+    double filterRadius = 0;
+    auto radiusStatus = settings.find("FilterRadius");
+    if (radiusStatus != settings.end())
+        filterRadius = *radiusStatus;
+    filter = Filter(filterType, filterRadius);
+
+    //try to find "Denoise", else keep the noise
+    auto denoiseStatus = settings.find("Denoise");
+    if (denoiseStatus != settings.end()) {
+        bool denoiseImage(*denoiseStatus);
+        denoise = denoiseImage;
     } else {
-        scene.setSuperSampling(1);
+        denoise = false;
     }
 
-    Point eye(jsonscene["Eye"]);
+    //try to find "FastMath", else use the exact libm functions
+    auto fastMathStatus = settings.find("FastMath");
+    if (fastMathStatus != settings.end()) {
+        bool fast(*fastMathStatus);
+        fastMath = fast;
+    } else {
+        fastMath = false;
+    }
+    scene.setFastMath(fastMath);
+
+    //try to find "GeometryBudget" (MiB), else keep all model geometry in
+    //memory
+    auto budgetStatus = settings.find("GeometryBudget");
+    if (budgetStatus != settings.end()) {
+        double budget(*budgetStatus);
+        if (budget <= 0)
+            throw runtime_error("GeometryBudget must be positive");
+        geometryBudget = static_cast<size_t>(budget * 1024 * 1024);
+    } else {
+        geometryBudget = 0;
+    }
+
+    //try to find "Acceleration", else pick the structure by its estimated
+    //cost
+    Accelerator::Structure structure = Accelerator::AUTOMATIC;
+    auto accelerationStatus = settings.find("Acceleration");
+    if (accelerationStatus != settings.end()) {
+        string const name = *accelerationStatus;
+        if (!Accelerator::structure(name, structure))
+            throw runtime_error("Unknown acceleration structure: " + name);
+    }
+    scene.setAcceleration(structure);
+
+    //try to find "LightSamples", else use all lights
+    auto lightSamplesStatus = settings.find("LightSamples");
+    if (lightSamplesStatus != settings.end()) {
+        int lightSamples(*lightSamplesStatus);
+        scene.setLightSamples(lightSamples);
+    } else {
+        scene.setLightSamples(0);
+    }
+
+    //try to find "Renderer", else render depth first (ray by ray)
+    auto rendererStatus = settings.find("Renderer");
+    if (rendererStatus != settings.end()) {
+        string const renderer = *rendererStatus;
+        if (renderer != "wavefront" && renderer != "depthfirst")
+            throw runtime_error("Unknown renderer: " + renderer);
+        scene.setWavefront(renderer == "wavefront");
+    } else {
+        scene.setWavefront(false);
+    }
+
+    //try to find "SortRays", else keep the secondary rays in order
+    auto sortStatus = settings.find("SortRays");
+    if (sortStatus != settings.end()) {
+        bool sort(*sortStatus);
+        scene.setSortRays(sort);
+    } else {
+        scene.setSortRays(false);
+    }
+
+    //try to find "Regions", a list of [x, y, width, height] rectangles,
+    //else render the whole frame
+    regions.clear();
+    auto regionsStatus = settings.find("Regions");
+    if (regionsStatus != settings.end()) {
+        for (auto const &regionNode : *regionsStatus) {
+            if (regionNode.size() != 4)
+                throw runtime_error("A region needs 4 values: x, y, width, height");
+            unsigned x = regionNode[0];
+            unsigned y = regionNode[1];
+            unsigned width = regionNode[2];
+            unsigned height = regionNode[3];
+            regions.push_back(Region{x, y, width, height});
+        }
+    }
+
+    //try to find "Composite", an image (in the directory of the scene) to
+    //render the regions into
+    compositeName.clear();
+    auto compositeStatus = settings.find("Composite");
+    if (compositeStatus != settings.end()) {
+        string s = *compositeStatus;
+        compositeName = scenePath(ifname, s);
+    }
+
+    //try to find "CheckpointInterval" (seconds), else do not checkpoint
+    auto checkpointStatus = settings.find("CheckpointInterval");
+    if (checkpointStatus != settings.end()) {
+        double interval(*checkpointStatus);
+        checkpointInterval = interval;
+    } else {
+        checkpointInterval = 0;
+    }
+
+    Point eye(settings["Eye"]);
     scene.setEye(eye);
+}
+
+unsigned Raytracer::buildScene(SceneDescription const &desc)
+{
+    for (LightRecord const &light : desc.lights)
+    {
+        if (light.shape == Light::RECTANGLE)
+            scene.addLight(Light(load(light.position), load(light.edge1), load(light.edge2),
+                                 load(light.color), light.samples));
+        else if (light.shape == Light::SPHERE)
+            scene.addLight(Light(load(light.position), light.radius, load(light.color),
+                                 light.samples));
+        else
+            scene.addLight(Light(load(light.position), load(light.color)));
+    }
 
+    // every texture image is only read once, even if materials share it
+    vector<Image> textures;
+    for (string const &texture : desc.textures)
+        textures.push_back(Image(texture));
 
-    for (auto const &lightNode : jsonscene["Lights"])
-        scene.addLight(parseLightNode(lightNode));
+    // the description already merged identical materials, the objects
+    // refer to the materials table of the scene by index
+    vector<uint32_t> materials;
+    for (MaterialRecord const &mat : desc.materials)
+    {
+        if (mat.texture >= 0)
+            materials.push_back(scene.addMaterial(Material(textures.at(mat.texture),
+                                                           mat.ka, mat.kd, mat.ks, mat.n, true)));
+        else
+            materials.push_back(scene.addMaterial(Material(load(mat.color),
+                                                           mat.ka, mat.kd, mat.ks, mat.n, false)));
+    }
+
+    // the shapes of every geometry get their own BVH, shared by all
+    // instances of the geometry
+    vector<shared_ptr<BVH const>> geometries;
+    for (GeometryRecord const &geometry : desc.geometries)
+        geometries.push_back(buildGeometry(geometry, desc));
 
     unsigned objCount = 0;
-    for (auto const &objectNode : jsonscene["Objects"])
-        if (parseObjectNode(objectNode, ifname))
-            ++objCount;
+    for (ObjectRecord const &record : desc.objects)
+    {
+        ObjectPtr obj = buildObject(record, geometries);
+        if (!obj)
+            continue;
 
+        obj->material = materials.at(record.material);
+        scene.addObject(obj);
+        ++objCount;
+    }
+    return objCount;
+}
+
+// the shapes are created in the arena of the scene, as the scene outlives
+// the instances and their BVH
+shared_ptr<BVH const> Raytracer::buildGeometry(GeometryRecord const &geometry,
+                                               SceneDescription const &desc)
+{
+    vector<ObjectPtr> objects;
+    for (unsigned idx = 0; idx != geometry.numObjects; ++idx)
+    {
+        ObjectPtr obj = buildObject(desc.geometryObjects.at(geometry.firstObject + idx), {});
+        if (obj)
+            objects.push_back(obj);
+    }
+
+    if (geometry.model >= 0 && geometryBudget > 0)
+    {
+        // only the boxes of the pages of the model are kept in memory
+        if (!pager)
+            pager = scene.getArena().create<Pager>(geometryBudget);
+        vector<ObjectPtr> pages = pager->load(desc.models.at(geometry.model), scene.getArena());
+        objects.insert(objects.end(), pages.begin(), pages.end());
+    }
+    else if (geometry.model >= 0)
+    {
+        OBJLoader model(desc.models.at(geometry.model));
+        vector<Vertex> vertices = model.vertex_data();
+        for (size_t idx = 0; idx + 2 < vertices.size(); idx += 3)
+        {
+            objects.push_back(scene.getArena().create<Triangle>(
+                Point(vertices[idx].x, vertices[idx].y, vertices[idx].z),
+                Point(vertices[idx + 1].x, vertices[idx + 1].y, vertices[idx + 1].z),
+                Point(vertices[idx + 2].x, vertices[idx + 2].y, vertices[idx + 2].z)));
+        }
+    }
+
+    if (objects.empty())
+        throw runtime_error("Empty geometry");
+
+    shared_ptr<BVH> bvh(new BVH);
+    bvh->build(objects);
+    return bvh;
+}
+
+ObjectPtr Raytracer::buildObject(ObjectRecord const &record,
+                                 vector<shared_ptr<BVH const>> const &geometries)
+{
+    double const *p = record.params;
+    Arena &arena = scene.getArena();
+
+    switch (record.type)
+    {
+        case OBJECT_SPHERE:
+            return arena.create<Sphere>(load(p), p[3], load(p + 4), p[7], fastMath);
+        case OBJECT_TRIANGLE:
+            return arena.create<Triangle>(load(p), load(p + 3), load(p + 6));
+        case OBJECT_PLANE:
+            return arena.create<Plane>(p[0], p[1], p[2], p[3]);
+        case OBJECT_QUAD:
+            return arena.create<Quad>(load(p), load(p + 3), load(p + 6), load(p + 9));
+        case OBJECT_INSTANCE:
+            return arena.create<Instance>(geometries.at(record.geometry), p);
+        default:
+            cerr << "Unknown object type in scene description: " << record.type << ".\n";
+            return nullptr;
+    }
+}
+
+bool Raytracer::readScene(string const &ifname)
+try
+{
+    // Use the binary cache of the scene if it is still up to date, else
+    // parse the JSON scene file and (re)write the cache
+    SceneDescription desc;
+    FileStamp stamp;
+    sceneHash = stamp.read(ifname) ? stamp.hash : 0;
+
+    if (SceneCache::read(ifname, desc))
+    {
+        cout << "Read scene from cache " << SceneCache::cacheName(ifname) << ".\n";
+    }
+    else
+    {
+        parseScene(ifname, desc);
+        if (!SceneCache::write(ifname, desc))
+            cerr << "Warning: could not write scene cache "
+                 << SceneCache::cacheName(ifname) << ".\n";
+    }
+
+// =============================================================================
+// -- Read your scene data in this section -------------------------------------
+// =============================================================================
+
+    parseSettings(json::parse(desc.settings), ifname);
+
+    unsigned objCount = buildScene(desc);
     cout << "Parsed " << objCount << " objects.\n";
 
 // =============================================================================
@@ -192,13 +690,222 @@ catch (exception const &ex)
     return false;
 }
 
-void Raytracer::renderToFile(string const &ofname)
+bool Raytracer::renderToFile(string const &ofname)
+try
+{
+    Image img = frameImage();
+    Image const base = img;
+    vector<Region> frame = frameRegions(img);
+    vector<Region> rendered = renderRegions(img, frame);
+
+    // the checkpoint is kept next to the output image, until it is written
+    unique_ptr<Checkpoint> checkpoint;
+    if (checkpointInterval > 0 || resume)
+    {
+        checkpoint.reset(new Checkpoint(ofname + ".checkpoint", renderKey(img, rendered),
+                                        img.width(), img.height(),
+                                        checkpointInterval > 0 ? checkpointInterval : 60));
+        if (resume && checkpoint->load())
+            cout << "Resuming from " << ofname << ".checkpoint, "
+                 << checkpoint->numDone() << " pixels are done.\n";
+        else if (resume)
+            cerr << "Warning: no checkpoint of this render to resume from, "
+                    "rendering everything.\n";
+    }
+
+    cout << "Tracing...\n";
+    scene.render(img, rendered, checkpoint.get());
+    if (pager)
+        cout << "Paged geometry: " << pager->numPages() << " pages, "
+             << pager->numLoads() << " loads, " << pager->numEvictions() << " evictions, peak "
+             << (pager->peakBytes() + 1023) / 1024 << " KiB of "
+             << (geometryBudget + 1023) / 1024 << " KiB.\n";
+
+    postProcess(img, base, frame, rendered);
+    writeImage(img, ofname);
+    if (checkpoint)
+        checkpoint->remove();
+    cout << "Done.\n";
+    return true;
+}
+catch (exception const &ex)
+{
+    cerr << ex.what() << '\n';
+    return false;
+}
+
+bool Raytracer::renderDistributed(string const &ofname, string const &address)
+try
+{
+    Image img = frameImage();
+    Image const base = img;
+    vector<Region> frame = frameRegions(img);
+
+    vector<Region> rendered = renderRegions(img, frame);
+
+    Coordinator coordinator(address);
+    cout << "Tracing with workers...\n";
+    coordinator.render(img, rendered, sceneHash);
+
+    postProcess(img, base, frame, rendered);
+    writeImage(img, ofname);
+    cout << "Done.\n";
+    return true;
+}
+catch (exception const &ex)
+{
+    cerr << ex.what() << '\n';
+    return false;
+}
+
+bool Raytracer::runWorker(string const &address)
+try
+{
+    // the workers render into a frame of the same size
+    Image img = frameImage();
+    cout << "Working for " << address << "...\n";
+    unsigned numTiles = Worker::run(address, scene, sceneHash, img.width(), img.height());
+    cout << "Done, rendered " << numTiles << " tiles.\n";
+    return true;
+}
+catch (exception const &ex)
+{
+    cerr << ex.what() << '\n';
+    return false;
+}
+
+void Raytracer::setRegions(vector<Region> const &newRegions)
+{
+    regions = newRegions;
+}
+
+void Raytracer::setComposite(string const &pngname)
+{
+    compositeName = pngname;
+}
+
+void Raytracer::setCheckpointInterval(double seconds)
+{
+    checkpointInterval = seconds;
+}
+
+void Raytracer::setResume(bool const &resumeRender)
+{
+    resume = resumeRender;
+}
+
+uint64_t Raytracer::renderKey(Image const &img, vector<Region> const &frame) const
+{
+    // a checkpoint belongs to the same scene file rendered at the same size
+    // and for the same regions
+    uint64_t key = hashBytes(&sceneHash, sizeof(sceneHash), 14695981039346656037ULL);
+    unsigned const size[2] = {img.width(), img.height()};
+    key = hashBytes(size, sizeof(size), key);
+    return hashBytes(frame.data(), frame.size() * sizeof(Region), key);
+}
+
+Image Raytracer::frameImage() const
 {
     // TODO: the size may be a settings in your file
     Image img(400, 400);
-    cout << "Tracing...\n";
-    scene.render(img);
+    if (!compositeName.empty())
+    {
+        Image composite(compositeName);
+        if (composite.width() != img.width() || composite.height() != img.height())
+            throw runtime_error("Composite image " + compositeName
+                                + " does not match the size of the frame");
+        img = composite;
+    }
+    return img;
+}
+
+vector<Region> Raytracer::frameRegions(Image const &img) const
+{
+    vector<Region> frame = regions;
+    if (frame.empty())
+        frame.push_back(Region{0, 0, img.width(), img.height()});
+    return frame;
+}
+
+vector<Region> Raytracer::renderRegions(Image const &img, vector<Region> const &frame) const
+{
+    // the filter needs the pixels around the regions too
+    unsigned margin = filter.margin();
+    vector<Region> rendered;
+    for (Region const &region : frame)
+    {
+        unsigned x0 = region.x > margin ? region.x - margin : 0;
+        unsigned y0 = region.y > margin ? region.y - margin : 0;
+        unsigned x1 = min(region.x + region.width + margin, img.width());
+        unsigned y1 = min(region.y + region.height + margin, img.height());
+        if (x0 < x1 && y0 < y1)
+            rendered.push_back(Region{x0, y0, x1 - x0, y1 - y0});
+    }
+    return rendered;
+}
+
+void Raytracer::postProcess(Image &img, Image const &base, vector<Region> const &frame,
+                            vector<Region> const &rendered)
+{
+    if (denoise)
+    {
+        cout << "Denoising...\n";
+        Features features(img.width(), img.height());
+        scene.renderFeatures(features, rendered);
+        Denoiser().apply(img, features);
+    }
+
+    if (filter.margin() == 0 && !denoise)
+        return;
+
+    filter.apply(img);
+
+    // only the regions are kept, the pixels around them are as before
+    // rendering
+    Image processed = base;
+    for (Region const &region : frame)
+    {
+        for (unsigned y = region.y; y < min(region.y + region.height, img.height()); ++y)
+        {
+            for (unsigned x = region.x; x < min(region.x + region.width, img.width()); ++x)
+                processed(x, y) = img(x, y);
+        }
+    }
+    img = processed;
+}
+
+void Raytracer::writeImage(Image &img, string const &ofname) const
+{
+    if (!regions.empty() && compositeName.empty())
+        img = crop(img);
+
     cout << "Writing image to " << ofname << "...\n";
     img.write_png(ofname);
-    cout << "Done.\n";
+}
+
+Image Raytracer::crop(Image const &img) const
+{
+    // bounding box of the regions, clipped to the frame
+    unsigned x0 = img.width();
+    unsigned y0 = img.height();
+    unsigned x1 = 0;
+    unsigned y1 = 0;
+    for (Region const &region : regions)
+    {
+        x0 = min(x0, region.x);
+        y0 = min(y0, region.y);
+        x1 = max(x1, min(region.x + region.width, img.width()));
+        y1 = max(y1, min(region.y + region.height, img.height()));
+    }
+    if (x0 >= x1 || y0 >= y1)
+        throw runtime_error("The regions are outside of the frame");
+
+    // pixels in the box but outside the regions stay black
+    Image cropped(x1 - x0, y1 - y0);
+    for (unsigned y = y0; y != y1; ++y)
+    {
+        for (unsigned x = x0; x != x1; ++x)
+            cropped(x - x0, y - y0) = img(x, y);
+    }
+    return cropped;
 }
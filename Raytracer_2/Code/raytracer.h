@@ -1,31 +1,93 @@
 #ifndef RAYTRACER_H_
 #define RAYTRACER_H_
 
+#include "filter.h"
+#include "region.h"
 #include "scene.h"
+#include "scenedescription.h"
 
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <vector>
 
 // Forward declerations
+class BVH;
+class Image;
 class Light;
 class Material;
+class Pager;
 
 #include "json/json_fwd.h"
 
 class Raytracer
 {
     Scene scene;
+    std::vector<Region> regions;    // empty: render the whole frame
+    std::string compositeName;      // image to render the regions into
+    double checkpointInterval = 0;  // seconds, 0: no checkpoints
+    bool resume = false;            // continue from the checkpoint
+    uint64_t sceneHash = 0;         // of the scene file, for checkpoints
+    Filter filter;                  // applied to the rendered image
+    bool denoise = false;           // run the Denoiser before the filter
+    bool fastMath = false;          // FastMath for shading and texture mapping
+    size_t geometryBudget = 0;      // bytes of paged model geometry, 0: no paging
+    Pager *pager = nullptr;         // of the models, in the arena of the scene
 
     public:
 
         bool readScene(std::string const &ifname);
-        void renderToFile(std::string const &ofname);
+        bool renderToFile(std::string const &ofname);
+
+        // Distributed rendering: the coordinator hands out tiles of the
+        // frame to workers connecting to address, which render them with
+        // the same scene file (see Coordinator and Worker).
+        bool renderDistributed(std::string const &ofname, std::string const &address);
+        bool runWorker(std::string const &address);
+
+        // Only render the regions. The output is cropped to the bounding
+        // box of the regions, unless a composite image is given: then the
+        // regions are rendered into (a copy of) that image.
+        void setRegions(std::vector<Region> const &newRegions);
+        void setComposite(std::string const &pngname);
+
+        // Write a checkpoint of the render every interval seconds, next
+        // to the output image. With resume a render continues from its
+        // checkpoint, the result is the same as rendered at once.
+        void setCheckpointInterval(double seconds);
+        void setResume(bool const &resumeRender);
 
     private:
 
-        bool parseObjectNode(nlohmann::json const &node, std::string const &ifname);
+        void parseScene(std::string const &ifname, SceneDescription &desc) const;
+        bool parseObjectNode(nlohmann::json const &node, std::string const &ifname,
+                             SceneDescription &desc) const;
+        bool parseShapeNode(nlohmann::json const &node, ObjectRecord &record,
+                            SceneDescription &desc) const;
+        void parseTransform(nlohmann::json const &node, double *matrix) const;
+        void parseGeometries(nlohmann::json const &node, std::string const &ifname,
+                             SceneDescription &desc) const;
+
+        LightRecord parseLightNode(nlohmann::json const &node) const;
+        MaterialRecord parseMaterialNode(nlohmann::json const &node, std::string const &ifname,
+                                         SceneDescription &desc) const;
+
+        void parseSettings(nlohmann::json const &settings, std::string const &ifname);
+        unsigned buildScene(SceneDescription const &desc);
+        std::shared_ptr<BVH const> buildGeometry(GeometryRecord const &geometry,
+                                                 SceneDescription const &desc);
+        ObjectPtr buildObject(ObjectRecord const &record,
+                              std::vector<std::shared_ptr<BVH const>> const &geometries);
 
-        Light parseLightNode(nlohmann::json const &node) const;
-        Material parseMaterialNode(nlohmann::json const &node, std::string const &ifname) const;
+        Image frameImage() const;
+        std::vector<Region> frameRegions(Image const &img) const;
+        std::vector<Region> renderRegions(Image const &img,
+                                          std::vector<Region> const &frame) const;
+        void postProcess(Image &img, Image const &base, std::vector<Region> const &frame,
+                         std::vector<Region> const &rendered);
+        void writeImage(Image &img, std::string const &ofname) const;
+        Image crop(Image const &img) const;
+        uint64_t renderKey(Image const &img, std::vector<Region> const &frame) const;
 };
 
 #endif
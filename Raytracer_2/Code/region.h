@@ -0,0 +1,21 @@
+#ifndef REGION_H_
+#define REGION_H_
+
+// Rectangle of pixels of the camera frame, (x, y) is its top left corner
+struct Region
+{
+    unsigned x;
+    unsigned y;
+    unsigned width;
+    unsigned height;
+};
+
+// Pixels [x0, x1) of row y
+struct Span
+{
+    unsigned y;
+    unsigned x0;
+    unsigned x1;
+};
+
+#endif
@@ -0,0 +1,238 @@
+#include "sampler.h"
+
+#include "random.h"
+
+#include <cmath>
+#include <limits>
+
+using namespace std;
+
+namespace
+{
+    unsigned const CANDIDATES = 32;     // per point of the blue noise set
+
+    // hash of a pixel, seeds the scrambling of its samples. Not Random's
+    // seed, so the scrambling is independent of the samples' generators.
+    uint32_t pixelHash(unsigned x, unsigned y, uint32_t salt)
+    {
+        uint32_t h = x * 0x8da6b343u ^ y * 0xd8163841u ^ salt * 0xcb1ab31fu;
+        h ^= h >> 16;
+        h *= 0x7feb352du;
+        h ^= h >> 15;
+        h *= 0x846ca68bu;
+        return h ^ (h >> 16);
+    }
+
+    double toUnit(uint32_t bits)
+    {
+        return bits * (1.0 / 4294967296.0);
+    }
+
+    // random permutation of [0, length), value at idx (Kensler, "Correlated
+    // Multi-Jittered Sampling", 2013)
+    unsigned permute(unsigned idx, unsigned length, uint32_t seed)
+    {
+        uint32_t w = length - 1;
+        w |= w >> 1;
+        w |= w >> 2;
+        w |= w >> 4;
+        w |= w >> 8;
+        w |= w >> 16;
+        uint32_t i = idx;
+        do
+        {
+            i ^= seed; i *= 0xe170893d;
+            i ^= seed >> 16;
+            i ^= (i & w) >> 4;
+            i ^= seed >> 8; i *= 0x0929eb3f;
+            i ^= seed >> 23;
+            i ^= (i & w) >> 1; i *= 1 | seed >> 27;
+            i *= 0x6935fa69;
+            i ^= (i & w) >> 11; i *= 0x74dcb303;
+            i ^= (i & w) >> 2; i *= 0x9e501cc5;
+            i ^= (i & w) >> 2; i *= 0xc860a3df;
+            i &= w;
+            i ^= i >> 5;
+        }
+        while (i >= length);
+        return (i + seed) % length;
+    }
+
+    double radicalInverse(unsigned idx, unsigned base)
+    {
+        double inverse = 1.0 / base;
+        double factor = inverse;
+        double result = 0.0;
+        for (; idx != 0; idx /= base, factor *= inverse)
+            result += (idx % base) * factor;
+        return result;
+    }
+
+    // the first two dimensions of the Sobol sequence, as 32 bit fractions
+    uint32_t sobol0(uint32_t idx)
+    {
+        uint32_t result = 0;
+        for (uint32_t v = 1u << 31; idx != 0; idx >>= 1, v >>= 1)
+        {
+            if (idx & 1)
+                result ^= v;
+        }
+        return result;
+    }
+
+    uint32_t sobol1(uint32_t idx)
+    {
+        uint32_t result = 0;
+        for (uint32_t v = 1u << 31; idx != 0; idx >>= 1, v ^= v >> 1)
+        {
+            if (idx & 1)
+                result ^= v;
+        }
+        return result;
+    }
+
+    // shifts a point over the unit square, wrapping around
+    double wrap(double value)
+    {
+        return value < 1.0 ? value : value - 1.0;
+    }
+}
+
+Sampler::Sampler(Pattern pattern, unsigned count)
+:
+    d_pattern(pattern),
+    d_count(count == 0 ? 1 : count)
+{
+    if (d_pattern == GRID)
+    {
+        // n x n points at 1/(n+1), ..., n/(n+1), the last rows filled
+        // partly when count is not a square
+        unsigned n = static_cast<unsigned>(ceil(sqrt(static_cast<double>(d_count))));
+        for (unsigned idx = 0; idx != d_count; ++idx)
+            d_base.push_back(Offset{(idx / n + 1.0) / (n + 1), (idx % n + 1.0) / (n + 1)});
+    }
+    else if (d_pattern == HALTON)
+    {
+        for (unsigned idx = 0; idx != d_count; ++idx)
+            d_base.push_back(Offset{radicalInverse(idx, 2), radicalInverse(idx, 3)});
+    }
+    else if (d_pattern == BLUE_NOISE)
+        bestCandidate();
+}
+
+unsigned Sampler::count() const
+{
+    return d_count;
+}
+
+void Sampler::offsets(unsigned x, unsigned y, vector<Offset> &result) const
+{
+    result.clear();
+    switch (d_pattern)
+    {
+        case GRID:
+            result = d_base;
+            break;
+
+        case JITTERED:
+            multiJittered(pixelHash(x, y, 0), result);
+            break;
+
+        case SOBOL:
+            sobol(pixelHash(x, y, 0), result);
+            break;
+
+        case HALTON:
+        case BLUE_NOISE:
+        {
+            // random shift over the unit square (Cranley-Patterson
+            // rotation), keeps the distances between the points
+            double shiftA = toUnit(pixelHash(x, y, 0));
+            double shiftB = toUnit(pixelHash(x, y, 1));
+            for (Offset const &offset : d_base)
+                result.push_back(Offset{wrap(offset.a + shiftA), wrap(offset.b + shiftB)});
+            break;
+        }
+    }
+}
+
+bool Sampler::pattern(string const &name, Pattern &result)
+{
+    if (name == "grid")
+        result = GRID;
+    else if (name == "jittered")
+        result = JITTERED;
+    else if (name == "halton")
+        result = HALTON;
+    else if (name == "sobol")
+        result = SOBOL;
+    else if (name == "bluenoise")
+        result = BLUE_NOISE;
+    else
+        return false;
+    return true;
+}
+
+// --- Private -----------------------------------------------------------------
+
+void Sampler::multiJittered(unsigned seed, vector<Offset> &result) const
+{
+    // m x n cells, m * n >= count. Sample s is in cell s and in row and
+    // column s of the fine grid, the permutations shuffle both.
+    unsigned m = static_cast<unsigned>(sqrt(static_cast<double>(d_count)));
+    unsigned n = (d_count + m - 1) / m;
+    Random rng(seed);
+    for (unsigned sample = 0; sample != d_count; ++sample)
+    {
+        unsigned s = permute(sample, d_count, seed * 0x51633e2d);
+        unsigned sx = permute(s % m, m, seed * 0x68bc21eb);
+        unsigned sy = permute(s / m, n, seed * 0x02e5be93);
+        double jx = rng.uniform();
+        double jy = rng.uniform();
+        result.push_back(Offset{(s % m + (sy + jx) / n) / m, (s / m + (sx + jy) / m) / n});
+    }
+}
+
+void Sampler::sobol(unsigned seed, vector<Offset> &result) const
+{
+    // random digit scrambling: xor with a random number keeps the
+    // stratification of the sequence
+    uint32_t scrambleA = seed;
+    uint32_t scrambleB = pixelHash(seed, 0, 1);
+    for (unsigned idx = 0; idx != d_count; ++idx)
+        result.push_back(Offset{toUnit(sobol0(idx) ^ scrambleA),
+                                toUnit(sobol1(idx) ^ scrambleB)});
+}
+
+void Sampler::bestCandidate()
+{
+    // every next point is the candidate farthest from the points so far
+    // (Mitchell), distances wrap around the unit square so the set tiles
+    // and survives the per pixel shift
+    Random rng(0);
+    d_base.push_back(Offset{rng.uniform(), rng.uniform()});
+    while (d_base.size() != d_count)
+    {
+        Offset best {0, 0};
+        double bestDistance = -1;
+        for (unsigned candidate = 0; candidate != CANDIDATES; ++candidate)
+        {
+            Offset point {rng.uniform(), rng.uniform()};
+            double distance = numeric_limits<double>::infinity();
+            for (Offset const &other : d_base)
+            {
+                double da = fabs(point.a - other.a);
+                double db = fabs(point.b - other.b);
+                da = min(da, 1 - da);
+                db = min(db, 1 - db);
+                distance = min(distance, da * da + db * db);
+            }
+            if (distance > bestDistance)
+            {
+                best = point;
+                bestDistance = distance;
+            }
+        }
+        d_base.push_back(best);
+    }
+}
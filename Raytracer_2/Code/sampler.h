@@ -0,0 +1,66 @@
+#ifndef SAMPLER_H_
+#define SAMPLER_H_
+
+#include <string>
+#include <vector>
+
+/**
+ * Positions of the samples within a pixel. Every pattern gives exactly
+ * the requested number of samples:
+ *
+ *  grid      - regular grid, the same in every pixel (aliases)
+ *  jittered  - correlated multi-jittered: one sample per cell of a grid
+ *              and per row and column of the finer n x n grid, any count
+ *  halton    - Halton points (bases 2 and 3)
+ *  sobol     - Sobol (0,2)-sequence, stratified for powers of two
+ *  bluenoise - best candidate point set, samples kept far apart
+ *
+ * The jittered, halton, sobol and bluenoise patterns are scrambled per
+ * pixel, so neighbouring pixels do not use the same positions.
+ */
+class Sampler
+{
+    public:
+
+        enum Pattern
+        {
+            GRID,
+            JITTERED,
+            HALTON,
+            SOBOL,
+            BLUE_NOISE
+        };
+
+        // offset of a sample within its pixel, in [0, 1)
+        struct Offset
+        {
+            double a;
+            double b;
+        };
+
+    private:
+
+        Pattern d_pattern;
+        unsigned d_count;
+        std::vector<Offset> d_base;     // unscrambled points of the pattern
+
+    public:
+
+        explicit Sampler(Pattern pattern = GRID, unsigned count = 1);
+
+        unsigned count() const;
+
+        // the offsets of the samples of pixel (x, y)
+        void offsets(unsigned x, unsigned y, std::vector<Offset> &result) const;
+
+        // the pattern called name, false if there is none
+        static bool pattern(std::string const &name, Pattern &result);
+
+    private:
+
+        void multiJittered(unsigned seed, std::vector<Offset> &result) const;
+        void sobol(unsigned seed, std::vector<Offset> &result) const;
+        void bestCandidate();
+};
+
+#endif
@@ -1,132 +1,565 @@
 #include "scene.h"
 
+#include "checkpoint.h"
+#include "denoiser.h"
 #include "hit.h"
 #include "image.h"
 #include "material.h"
+#include "random.h"
 #include "ray.h"
+#include "wavefront.h"
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <iomanip>
+#include <iostream>
 #include <limits>
 
 using namespace std;
 
-Color Scene::trace(Ray const &ray, int const reflectionDepth)
+namespace
 {
-    // Find hit object and distance
-    Hit min_hit(numeric_limits<double>::infinity(), Vector());
-    ObjectPtr obj = nullptr;
-    for (unsigned idx = 0; idx != objects.size(); ++idx)
+    unsigned const SHADOW_PROBES = 4;   // first shadow rays of area lights
+}
+
+Color Scene::trace(Ray const &ray, int const reflectionDepth, Random &rng)
+{
+    ShadowCache shadows(lights.size());
+    return (this->*kernel(reflectionDepth))(ray, reflectionDepth, rng, shadows);
+}
+
+template <bool Shadows, bool Textures, bool Reflections, Scene::Lighting Lights>
+Color Scene::traceWith(Ray const &ray, int reflectionDepth, Random &rng,
+                       ShadowCache &shadows)
+{
+    // Follow the ray and its reflections in a loop instead of recursing.
+    // weight is the fraction of the color at the current hit that reaches
+    // the eye (the product of the ks of all surfaces reflected so far).
+    Color result;
+    Ray current = ray;
+    double weight = 1.0;
+
+    for (int depth = reflectionDepth; ; --depth)
     {
-        Hit hit(objects[idx]->intersect(ray));
-        if (hit.t < min_hit.t && hit.t > 0)
-        {
-            min_hit = hit;
-            obj = objects[idx];
+        // Find hit object and distance
+        Hit min_hit(numeric_limits<double>::infinity(), Vector());
+        int idx = accelerator.intersect(current, min_hit);
+
+        // No hit? Background color (black) adds nothing.
+        if (idx < 0) break;
+        ObjectPtr const &obj = objects[idx];
+        if (Textures)
+            mapTexture(*obj, min_hit);
+
+        Material const *material = &materials[obj->material];  //the hit objects material
+        Point hit = current.at(min_hit.t);             //the hit point
+        Vector N = min_hit.N;                          //the normal at hit point
+
+        result += weight * shade<Shadows, Textures, Lights>(current, obj, *material, hit,
+                                                            min_hit, rng, shadows);
+
+        if (!Reflections || depth <= 0 || material->ks <= 0.0)
+            break;
+
+        //the reflected ray only contributes ks times its color
+        weight *= material->ks;
+        if (weight < reflectionThreshold) {
+            if (!russianRoulette)
+                break;
+
+            //russian roulette: continue with probability weight / threshold
+            //and compensate, which keeps the expected color the same
+            double survival = weight / reflectionThreshold;
+            if (rng.uniform() >= survival)
+                break;
+            weight /= survival;
         }
+
+        //find the reflection color by sending a ray in the reflection direction
+        //and determine the color of the object which the ray hits
+        double s = N.dot(current.D)*2;
+        Triple R = current.D - (N*s);
+        R.normalize();
+        //we add a small instance of reflection vector to hit to make sure we are on the right side of the sphere
+        current = Ray(hit + 0.1 * R, R);
     }
 
-    // No hit? Return background color.
-    if (!obj) return Color(0.0, 0.0, 0.0);
+    return result;
+}
 
-    Material *material = &(obj->material);         //the hit objects material
-    Point hit = ray.at(min_hit.t);                 //the hit point
-    Vector N = min_hit.N;                          //the normal at hit point
+template <bool Shadows, bool Textures, Scene::Lighting Lights>
+Color Scene::shade(Ray const &ray, ObjectPtr const &obj, Material const &material,
+                   Point const &hit, Hit const &surface, Random &rng,
+                   ShadowCache &shadows)
+{
+    Vector const &N = surface.N;                   //the normal at hit point
     Vector V = -ray.D;                             //the view vector
+    Color color = Textures ? surfaceColor(material, surface) : material.color;
 
-    // Find color depending on the material having texture or not
-    Color color;
-    if (material->hasTexture == true) {
-        float u, v;
-        //pointmaping needs unit vector from hitpoint pointing to sphere's origin
-        //this is exactly minus one times the normal vector
-        std::tie(u,v) = obj->pointMapping((-1*N).normalized());
-        Image im = material->texture;
-        color = im.colorAt(u, v);
+    /* Calculation of the color (Phong model) */
+
+    Triple I_a = color * material.ka; //ambient color
+    Triple I_d;
+    Specular I_s(material.n, fastMath);
+
+    //the light reaching the hit, partly for the penumbra of area lights
+    auto addLight = [&](unsigned idx, double weight)
+    {
+        if (Shadows)
+            weight *= shadowFraction(idx, obj, hit, shadowSeed(*lights[idx], rng), shadows);
+        if (weight > 0.0)
+            lightIntensity(*lights[idx], hit, N, V, weight, I_d, I_s);
+    };
+
+    if (Lights == SAMPLED_LIGHTS) {
+        //many lights: only use a few lights, picked at random proportional
+        //to their contribution. Dividing by the probability keeps the
+        //expected value equal to the sum over all lights.
+        for (int i = 0; i < lightSamples; i++) {
+            double pdf;
+            int idx = lightTree.sample(hit, N, rng.uniform(), pdf);
+            if (idx >= 0)
+                addLight(idx, 1.0 / (pdf * lightSamples));
+        }
+    } else if (Lights == ONE_LIGHT) {
+        //the light tree of a single light only has the test whether the
+        //light is in front of the surface
+        if (N.dot(lights[0]->position - hit) > 0.0)
+            addLight(0, 1.0);
     } else {
-        color = material->color;
+        //find the color for all light sources in front of the surface and
+        //sum them, lights behind the surface can not contribute
+        lightTree.forEachInFront(hit, N, [&](unsigned idx) {
+            addLight(idx, 1.0);
+        });
     }
+    I_d = I_d * (material.kd) * (color);
 
-    /* Calculation of the color (Phong model) */
+    return I_a + I_d + I_s.sum() * (material.ks);
+}
+
+void Scene::mapTexture(Object &obj, Hit &hit) const
+{
+    //pointmaping needs unit vector from hitpoint pointing to sphere's origin
+    //this is exactly minus one times the normal vector
+    if (materials[obj.material].hasTexture)
+        std::tie(hit.u, hit.v) = obj.pointMapping((-1 * hit.N).normalized());
+}
 
-    Triple I_a = color * material->ka; //ambient color
-    Triple I_d, I_s;
+Color Scene::surfaceColor(Material const &material, Hit const &surface) const
+{
+    // Find color depending on the material having texture or not, the
+    // texture coordinates were set with the attributes of the hit
+    if (material.hasTexture == true)
+        return material.texture.colorAt(surface.u, surface.v);
+    return material.color;
+}
 
-    //find the color for all light sources and sum them
-    for (int i = 0; i < lights.size(); i++) {
-        Triple L = (lights[i]->position) - (hit);
-        L.normalize();
-        Ray rayFromLight = Ray(lights[i]->position, (hit - lights[i]->position).normalized());
-        if (shadowOn == false || getClosest(rayFromLight) == obj) {
-            //the light hits the object of which we want to determine the color
-            I_d += (lights[i]->color) * max(0.0, N.dot(L));
+bool Scene::visible(unsigned light, ObjectPtr const &obj, Point const &hit,
+                    ShadowCache &shadows)
+{
+    //the light hits the object of which we want to determine the color
+    //if the object is the first one hit by a ray from the light
+    Point const &position = lights[light]->position;
+    return reaches(light, obj, Ray(position, (hit - position).normalized()), shadows);
+}
 
-            double s = N.dot(L)*2;
-            Triple R = (N*s) - L; //reflection vector
-            R.normalize();
+bool Scene::reaches(unsigned light, ObjectPtr const &obj, Ray const &ray,
+                    ShadowCache &shadows)
+{
+    ++shadows.rays;
 
-            double maximum = max(0.0, R.dot(V));
-            I_s += lights[i]->color * pow(maximum, material->n);
+    //if the last occluder of the light is hit before obj, obj can not be
+    //the closest hit and the ray is blocked without traversing the scene
+    ObjectPtr &occluder = shadows.occluders[light];
+    if (occluder) {
+        Hit occluderHit;
+        occluder->distance(ray, occluderHit);
+        if (occluderHit.t > 0) {
+            Hit objHit;
+            obj->distance(ray, objHit);
+            if (occluderHit.t < objHit.t) {
+                ++shadows.blocked;
+                ++shadows.hits;
+                return false;
+            }
         }
     }
-    I_d = I_d * (material->kd) * (color);
-    I_s = I_s * (material->ks);
 
-    Color reflectionColor;
-    if (reflectionDepth > 0 && material->ks > 0.0) {
-        //find the reflection color by sending a ray in the reflection direction
-        //and determine the color of the object which the ray hits
-        double s = N.dot(ray.D)*2;
-        Triple R = ray.D - (N*s);
-        R.normalize();
-        //we add a small instance of reflection vector to hit to make sure we are on the right side of the sphere
-        reflectionColor = trace(Ray(hit + 0.1 * R, R), reflectionDepth-1);
-        reflectionColor = reflectionColor * material->ks;
+    ObjectPtr closest = getClosest(ray);
+    if (closest == obj)
+        return true;
+
+    ++shadows.blocked;
+    if (closest)
+        occluder = closest;
+    return false;
+}
+
+double Scene::shadowFraction(unsigned idx, ObjectPtr const &obj, Point const &hit,
+                             uint32_t seed, ShadowCache &shadows)
+{
+    Light const &light = *lights[idx];
+    if (!light.area())
+        return visible(idx, obj, hit, shadows) ? 1.0 : 0.0;
+
+    //jittered samples on the light, in columns x rows strata for count
+    //samples, the probes one in each quarter of it
+    Random rng(seed);
+    auto unblocked = [&](unsigned sample, unsigned count) -> unsigned
+    {
+        unsigned columns = static_cast<unsigned>(ceil(sqrt(count)));
+        unsigned rows = (count + columns - 1) / columns;
+        double a = (sample % columns + rng.uniform()) / columns;
+        double b = (sample / columns + rng.uniform()) / rows;
+        Point origin = light.sample(hit, a, b);
+        return reaches(idx, obj, Ray(origin, (hit - origin).normalized()), shadows);
+    };
+
+    unsigned numLit = 0;
+    if (light.samples <= SHADOW_PROBES)
+    {
+        for (unsigned sample = 0; sample != light.samples; ++sample)
+            numLit += unblocked(sample, light.samples);
+        return static_cast<double>(numLit) / light.samples;
     }
 
-    return I_a + I_d + I_s + reflectionColor;
+    for (unsigned sample = 0; sample != SHADOW_PROBES; ++sample)
+        numLit += unblocked(sample, SHADOW_PROBES);
+    if (numLit == 0 || numLit == SHADOW_PROBES)
+        return numLit == 0 ? 0.0 : 1.0;
+
+    //penumbra: the rest of the samples, spread over the whole light
+    unsigned const rest = light.samples - SHADOW_PROBES;
+    for (unsigned sample = 0; sample != rest; ++sample)
+        numLit += unblocked(sample, rest);
+    return static_cast<double>(numLit) / light.samples;
 }
 
-ObjectPtr Scene::getClosest(Ray const &ray) {
-    Hit min_hit(numeric_limits<double>::infinity(), Vector());
-    ObjectPtr obj = nullptr;
-    for (unsigned idx = 0; idx != objects.size(); ++idx)
+uint32_t Scene::shadowSeed(Light const &light, Random &rng)
+{
+    return light.area() ? rng.next() : 0;
+}
+
+void Scene::lightIntensity(Light const &light, Point const &hit, Vector const &N,
+                           Vector const &V, double weight,
+                           Triple &I_d, Specular &I_s) const
+{
+    Triple L = (light.position) - (hit);
+    L.normalize();
+    I_d += (light.color) * (max(0.0, N.dot(L)) * weight);
+
+    double s = N.dot(L)*2;
+    Triple R = (N*s) - L; //reflection vector
+    R.normalize();
+
+    double maximum = max(0.0, R.dot(V));
+    I_s.add(light.color, maximum, weight);
+}
+
+Scene::ShadowCache::ShadowCache(size_t numLights)
+:
+    occluders(numLights, nullptr)
+{}
+
+Scene::Specular::Specular(double n, bool fast)
+:
+    d_n(n),
+    d_fast(fast)
+{}
+
+void Scene::Specular::add(Triple const &color, double base, double weight)
+{
+    if (!d_fast)
     {
-        Hit hit(objects[idx]->intersect(ray));
-        if (hit.t < min_hit.t && hit.t > 0)
-        {
-            min_hit = hit;
-            obj = objects[idx];
-        }
+        d_sum += color * (pow(base, d_n) * weight);
+        return;
     }
-    return obj;
+
+    d_base[d_size] = base;
+    d_color[d_size] = color * weight;
+    if (++d_size == FastMath::LANES)
+        flush();
+}
+
+Triple Scene::Specular::sum()
+{
+    flush();
+    return d_sum;
+}
+
+void Scene::Specular::flush()
+{
+    if (d_size == 0)
+        return;
+
+    float exponent[FastMath::LANES];
+    float highlight[FastMath::LANES];
+    fill(exponent, exponent + d_size, static_cast<float>(d_n));
+    FastMath::pow(d_base, exponent, highlight, d_size);
+    for (unsigned idx = 0; idx != d_size; ++idx)
+        d_sum += d_color[idx] * highlight[idx];
+    d_size = 0;
+}
+
+ObjectPtr Scene::getClosest(Ray const &ray) {
+    //only the object is needed, not the normal or texture coordinates
+    Hit min_hit(numeric_limits<double>::infinity(), Vector());
+    int idx = accelerator.closest(ray, min_hit);
+    return idx < 0 ? nullptr : objects[idx];
 }
 
 void Scene::render(Image &img)
 {
-    unsigned w = img.width();
+    render(img, {Region{0, 0, img.width(), img.height()}});
+}
+
+void Scene::render(Image &img, vector<Region> const &regions, Checkpoint *checkpoint)
+{
+    prepare(img.width(), img.height());
+
+    // only the pixels of the regions are rendered, the rest of img is
+    // left as it is
+    vector<Span> rowSpans = spans(img, regions);
+    if (checkpoint)
+    {
+        checkpoint->restore(img);
+        rowSpans = unfinished(rowSpans, *checkpoint);
+    }
+
+    if (wavefront)
+    {
+        Wavefront(*this).render(img, rowSpans, checkpoint);
+        return;
+    }
+
     unsigned h = img.height();
-    float step  = 1.0/(superSampling + 1);
+    Kernel const traceKernel = kernel(maxRecursionDepth);
+    unsigned long long shadowRays = 0;
+    unsigned long long blocked = 0;
+    unsigned long long cacheHits = 0;
 
-    #pragma omp parallel num_threads(2)
-    #pragma omp parallel for
-    for (unsigned y = 0; y < h; ++y)
+    // every thread keeps its own occluder cache over the rows it renders
+    #pragma omp parallel reduction(+:shadowRays, blocked, cacheHits)
     {
-        for (unsigned x = 0; x < w; ++x)
+        ShadowCache shadows(lights.size());
+
+        #pragma omp for schedule(dynamic)
+        for (size_t idx = 0; idx < rowSpans.size(); ++idx)
         {
-            Color col;
-            for(float a = step; a < 1; a+=step) {
-                for(float b = step; b < 1; b+=step) {
-                    Point pixel(x + a, h - 1 - y + b, 0);
+            vector<Sampler::Offset> offsets;
+            unsigned y = rowSpans[idx].y;
+            for (unsigned x = rowSpans[idx].x0; x < rowSpans[idx].x1; ++x)
+            {
+                sampler.offsets(x, y, offsets);
+                Color col;
+                for (unsigned sample = 0; sample != offsets.size(); ++sample) {
+                    Point pixel(x + offsets[sample].a, h - 1 - y + offsets[sample].b, 0);
                     Ray ray(eye, (pixel - eye).normalized());
-                    col += trace(ray, maxRecursionDepth);
+                    Random rng(x, y, sample);
+                    col += (this->*traceKernel)(ray, maxRecursionDepth, rng, shadows);
                 }
+                //get the mean value for color over rays in a pixel
+                col /= offsets.size();
+                col.clamp();
+                img(x, y) = col;
+            }
+            if (checkpoint)
+                checkpoint->complete(img, {rowSpans[idx]});
+        }
+
+        shadowRays += shadows.rays;
+        blocked += shadows.blocked;
+        cacheHits += shadows.hits;
+    }
+    report(shadowRays, blocked, cacheHits);
+}
+
+void Scene::renderFeatures(Features &features, vector<Region> const &regions)
+{
+    prepare(features.width, features.height);
+
+    // the camera rays of the samples, as in render, only their first hit
+    Image const frame(features.width, features.height);
+    vector<Span> const rowSpans = spans(frame, regions);
+    unsigned h = features.height;
+
+    #pragma omp parallel for schedule(dynamic)
+    for (size_t idx = 0; idx < rowSpans.size(); ++idx)
+    {
+        vector<Sampler::Offset> offsets;
+        unsigned y = rowSpans[idx].y;
+        for (unsigned x = rowSpans[idx].x0; x < rowSpans[idx].x1; ++x)
+        {
+            sampler.offsets(x, y, offsets);
+            Vector normal;
+            double depth = 0.0;
+            Color albedo;
+            for (Sampler::Offset const &offset : offsets) {
+                Point pixel(x + offset.a, h - 1 - y + offset.b, 0);
+                Ray ray(eye, (pixel - eye).normalized());
+                Hit hit(numeric_limits<double>::infinity(), Vector());
+                int obj = accelerator.intersect(ray, hit);
+                if (obj < 0)
+                    continue;
+                mapTexture(*objects[obj], hit);
+                normal += hit.N;
+                depth += hit.t;
+                albedo += surfaceColor(materials[objects[obj]->material], hit);
             }
-            //get the mean value for color over rays in a pixel
-            col /= (superSampling*superSampling);
-            col.clamp();
-            img(x, y) = col;
+
+            unsigned pixel = y * features.width + x;
+            features.normal[pixel] = normal / offsets.size();
+            features.depth[pixel] = depth / offsets.size();
+            features.albedo[pixel] = albedo / offsets.size();
+            features.rendered[pixel] = 1;
+        }
+    }
+}
+
+Scene::Kernel Scene::kernel(int reflectionDepth) const
+{
+    bool textures = false;
+    bool reflective = false;
+    for (Material const &material : materials)
+    {
+        textures = textures || material.hasTexture;
+        reflective = reflective || material.ks > 0.0;
+    }
+
+    Lighting lighting = ALL_LIGHTS;
+    if (lightSamples > 0)
+        lighting = SAMPLED_LIGHTS;
+    else if (lights.size() == 1)
+        lighting = ONE_LIGHT;
+
+    bool reflections = reflective && reflectionDepth > 0;
+    return shadowOn ? kernel<true>(textures, reflections, lighting)
+                    : kernel<false>(textures, reflections, lighting);
+}
+
+template <bool Shadows>
+Scene::Kernel Scene::kernel(bool textures, bool reflections, Lighting lighting)
+{
+    return textures ? kernel<Shadows, true>(reflections, lighting)
+                    : kernel<Shadows, false>(reflections, lighting);
+}
+
+template <bool Shadows, bool Textures>
+Scene::Kernel Scene::kernel(bool reflections, Lighting lighting)
+{
+    return reflections ? kernel<Shadows, Textures, true>(lighting)
+                       : kernel<Shadows, Textures, false>(lighting);
+}
+
+template <bool Shadows, bool Textures, bool Reflections>
+Scene::Kernel Scene::kernel(Lighting lighting)
+{
+    switch (lighting)
+    {
+        case ONE_LIGHT:
+            return &Scene::traceWith<Shadows, Textures, Reflections, ONE_LIGHT>;
+        case SAMPLED_LIGHTS:
+            return &Scene::traceWith<Shadows, Textures, Reflections, SAMPLED_LIGHTS>;
+        default:
+            return &Scene::traceWith<Shadows, Textures, Reflections, ALL_LIGHTS>;
+    }
+}
+
+void Scene::prepare(unsigned width, unsigned height)
+{
+    // built once, a worker renders many tiles of the same scene
+    if (prepared)
+        return;
+
+    // the structure is picked for the camera rays of the whole frame and
+    // the shadow rays of the lights (samples) at their hits, at least the
+    // probes for area lights
+    double numRays = static_cast<double>(width) * height * sampler.count();
+    if (shadowOn && !lights.empty())
+    {
+        double shadowRays = 0;
+        for (LightPtr light : lights)
+            shadowRays += min(light->samples, SHADOW_PROBES);
+        if (lightSamples > 0)
+            shadowRays *= static_cast<double>(lightSamples) / lights.size();
+        numRays *= 1 + shadowRays;
+    }
+
+    auto start = chrono::steady_clock::now();
+    accelerator.build(objects, acceleration, numRays);
+    chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+    cout << "Acceleration structure: " << accelerator.description() << ", built in "
+         << fixed << setprecision(1) << elapsed.count() << " ms.\n" << defaultfloat;
+
+    lightTree.build(lights);
+    prepared = true;
+}
+
+void Scene::report(unsigned long long rays, unsigned long long blocked,
+                   unsigned long long hits)
+{
+    if (rays == 0)
+        return;
+
+    cout << "Shadows: " << rays << " shadow rays, " << blocked << " blocked";
+    if (blocked != 0)
+        cout << ", " << fixed << setprecision(1) << 100.0 * hits / blocked
+             << "% by the last occluder" << defaultfloat;
+    cout << ".\n";
+}
+
+vector<Span> Scene::spans(Image const &img, vector<Region> const &regions)
+{
+    // for every row the ranges of pixels covered by the regions, clipped
+    // to the image. Overlapping ranges are merged so no pixel is rendered
+    // twice.
+    vector<Span> result;
+    vector<pair<unsigned, unsigned>> ranges;
+    for (unsigned y = 0; y != img.height(); ++y)
+    {
+        ranges.clear();
+        for (Region const &region : regions)
+        {
+            if (y < region.y || y - region.y >= region.height || region.x >= img.width())
+                continue;
+            ranges.push_back(make_pair(region.x, min(region.x + region.width, img.width())));
+        }
+        sort(ranges.begin(), ranges.end());
+
+        for (auto const &range : ranges)
+        {
+            if (range.first == range.second)
+                continue;
+            if (!result.empty() && result.back().y == y && range.first <= result.back().x1)
+                result.back().x1 = max(result.back().x1, range.second);
+            else
+                result.push_back(Span{y, range.first, range.second});
+        }
+    }
+    return result;
+}
+
+vector<Span> Scene::unfinished(vector<Span> const &spans, Checkpoint const &checkpoint)
+{
+    // the spans without the pixels finished before
+    vector<Span> result;
+    for (Span const &span : spans)
+    {
+        unsigned x = span.x0;
+        while (x != span.x1)
+        {
+            for (; x != span.x1 && checkpoint.done(x, span.y); ++x)
+                ;
+            unsigned x0 = x;
+            for (; x != span.x1 && !checkpoint.done(x, span.y); ++x)
+                ;
+            if (x0 != x)
+                result.push_back(Span{span.y, x0, x});
         }
     }
+    return result;
 }
 
 // --- Misc functions ----------------------------------------------------------
@@ -134,11 +567,19 @@ void Scene::render(Image &img)
 void Scene::addObject(ObjectPtr obj)
 {
     objects.push_back(obj);
+    prepared = false;
+}
+
+uint32_t Scene::addMaterial(Material const &material)
+{
+    materials.push_back(material);
+    return materials.size() - 1;
 }
 
 void Scene::addLight(Light const &light)
 {
-    lights.push_back(LightPtr(new Light(light)));
+    lights.push_back(arena.create<Light>(light));
+    prepared = false;
 }
 
 void Scene::setEye(Triple const &position)
@@ -156,9 +597,50 @@ void Scene::setMaxRecursionDepth(int const &depth)
     maxRecursionDepth = depth;
 }
 
-void Scene::setSuperSampling(int const &sampling)
+void Scene::setSampler(Sampler const &pixelSampler)
+{
+    sampler = pixelSampler;
+}
+
+void Scene::setReflectionThreshold(double const &threshold)
+{
+    reflectionThreshold = threshold;
+}
+
+void Scene::setRussianRoulette(bool const &roulette)
+{
+    russianRoulette = roulette;
+}
+
+void Scene::setWavefront(bool const &enabled)
+{
+    wavefront = enabled;
+}
+
+void Scene::setSortRays(bool const &sort)
+{
+    sortRays = sort;
+}
+
+void Scene::setFastMath(bool const &fast)
+{
+    fastMath = fast;
+}
+
+void Scene::setAcceleration(Accelerator::Structure const &structure)
+{
+    acceleration = structure;
+    prepared = false;
+}
+
+void Scene::setLightSamples(int const &samples)
+{
+    lightSamples = samples;
+}
+
+Arena &Scene::getArena()
 {
-    superSampling = sampling;
+    return arena;
 }
 
 unsigned Scene::getNumObject()
@@ -1,45 +1,214 @@
 #ifndef SCENE_H_
 #define SCENE_H_
 
+#include "accelerator.h"
+#include "arena.h"
+#include "fastmath.h"
 #include "light.h"
+#include "lighttree.h"
+#include "material.h"
 #include "object.h"
+#include "region.h"
+#include "sampler.h"
 #include "triple.h"
 
 #include <vector>
 
 // Forward declerations
+class Checkpoint;
+struct Features;
 class Ray;
 class Image;
+class Random;
 
 class Scene
 {
+    friend class Wavefront;         // renders with the scene's data
+
+    Arena arena;                    // owns the objects and lights, first so
+                                    // it is destroyed last
     std::vector<ObjectPtr> objects;
-    std::vector<LightPtr> lights;   // no ptr needed, but kept for consistency
+    std::vector<Material> materials;    // Object::material indexes this
+    std::vector<LightPtr> lights;
+    Accelerator accelerator;        // over the objects, built by render
+    Accelerator::Structure acceleration = Accelerator::AUTOMATIC;
+    LightTree lightTree;
+    bool prepared = false;          // accelerator and lightTree are up to date
     Point eye;
     bool shadowOn;
     int maxRecursionDepth;
-    int superSampling;
+    double reflectionThreshold;     // stop reflecting below this weight
+    bool russianRoulette;           // or continue at random
+    Sampler sampler;                // positions of the samples in a pixel
+    int lightSamples;               // 0: use all lights
+    bool wavefront;                 // render with the Wavefront renderer
+    bool sortRays;                  // wavefront: sort secondary rays
+    bool fastMath = false;          // approximate pow and texture mapping
+
+    // Sum of the specular highlights of the lights at a hit: the light
+    // color times pow(R.V, n). With fast math the highlights are collected
+    // and their pow calls done FastMath::LANES at a time.
+    class Specular
+    {
+        double d_n;
+        bool d_fast;
+        Triple d_sum;
+        unsigned d_size = 0;
+        float d_base[FastMath::LANES];
+        Triple d_color[FastMath::LANES];    // light color times weight
+
+        public:
+            Specular(double n, bool fast);
+
+            void add(Triple const &color, double base, double weight);
+            Triple sum();
+
+        private:
+            void flush();
+    };
+
+    // The last object that blocked a shadow ray of each light, kept per
+    // thread. Nearby points are mostly blocked by the same object, so it
+    // is tested before the acceleration structure is traversed.
+    struct ShadowCache
+    {
+        std::vector<ObjectPtr> occluders;   // per light, nullptr if none yet
+        unsigned long long rays = 0;        // shadow rays traced
+        unsigned long long blocked = 0;
+        unsigned long long hits = 0;        // blocked by the cached occluder
+
+        explicit ShadowCache(size_t numLights);
+    };
+
+    // How the lights are handled at a hit: the only light, all lights in
+    // front of the surface, or "LightSamples" lights picked at random
+    enum Lighting
+    {
+        ONE_LIGHT,
+        ALL_LIGHTS,
+        SAMPLED_LIGHTS
+    };
+
+    // trace with the features of the scene compiled in, see kernel()
+    typedef Color (Scene::*Kernel)(Ray const &ray, int reflectionDepth, Random &rng,
+                                   ShadowCache &shadows);
 
     public:
 
-        // trace a ray into the scene and return the color
-        Color trace(Ray const &ray, int const reflectionDepth);
+        // trace a ray into the scene and return the color. Picks the
+        // kernel for every call, render picks it once.
+        Color trace(Ray const &ray, int const reflectionDepth, Random &rng);
         Color getReflection(Ray const &ray, int const reflectionDepth);
 
         // render the scene to the given image
         void render(Image &img);
 
+        // only render the pixels inside the regions of the image. With a
+        // checkpoint, its finished pixels are restored instead of rendered
+        // and the newly finished pixels are reported to it.
+        void render(Image &img, std::vector<Region> const &regions,
+                    Checkpoint *checkpoint = nullptr);
+
+        // the normal, depth and albedo of the first hits of the camera
+        // rays of the regions, for the Denoiser
+        void renderFeatures(Features &features, std::vector<Region> const &regions);
+
         ObjectPtr getClosest(Ray const &ray);
 
+        // obj has to be created in the arena of the scene
         void addObject(ObjectPtr obj);
+        uint32_t addMaterial(Material const &material);   // returns its index
         void addLight(Light const &light);
         void setEye(Triple const &position);
         void setShadow(bool const &shadow);
         void setMaxRecursionDepth(int const &depth);
-        void setSuperSampling(int const &sampling);
+        void setSampler(Sampler const &pixelSampler);
+        void setReflectionThreshold(double const &threshold);
+        void setRussianRoulette(bool const &roulette);
+        void setLightSamples(int const &samples);
+        void setWavefront(bool const &enabled);
+        void setSortRays(bool const &sort);
+        void setFastMath(bool const &fast);
+        void setAcceleration(Accelerator::Structure const &structure);
+
+        // creates the objects of the scene (also the shapes of instanced
+        // geometries), they live as long as the scene
+        Arena &getArena();
 
         unsigned getNumObject();
         unsigned getNumLights();
+
+    private:
+
+        // The trace kernel for the features the scene uses, for rays with
+        // reflectionDepth reflections. The settings and materials are
+        // checked here once, instead of for every hit.
+        Kernel kernel(int reflectionDepth) const;
+
+        template <bool Shadows>
+        static Kernel kernel(bool textures, bool reflections, Lighting lighting);
+        template <bool Shadows, bool Textures>
+        static Kernel kernel(bool reflections, Lighting lighting);
+        template <bool Shadows, bool Textures, bool Reflections>
+        static Kernel kernel(Lighting lighting);
+
+        // Shadows: shadow rays are traced, Textures: some material has a
+        // texture, Reflections: some material reflects and the recursion
+        // depth is not 0
+        template <bool Shadows, bool Textures, bool Reflections, Lighting Lights>
+        Color traceWith(Ray const &ray, int reflectionDepth, Random &rng,
+                        ShadowCache &shadows);
+
+        // local (Phong) color of the hit, without reflections
+        template <bool Shadows, bool Textures, Lighting Lights>
+        Color shade(Ray const &ray, ObjectPtr const &obj, Material const &material,
+                    Point const &hit, Hit const &surface, Random &rng,
+                    ShadowCache &shadows);
+
+        // sets the texture coordinates of the closest hit on obj, if its
+        // material has a texture
+        void mapTexture(Object &obj, Hit &hit) const;
+
+        // color of the material at the hit (texture or plain color)
+        Color surfaceColor(Material const &material, Hit const &surface) const;
+
+        // shadow test: true if the light (index) reaches hit on obj
+        bool visible(unsigned light, ObjectPtr const &obj, Point const &hit,
+                     ShadowCache &shadows);
+
+        // true if the first object hit by a ray from the light is obj
+        bool reaches(unsigned light, ObjectPtr const &obj, Ray const &ray,
+                     ShadowCache &shadows);
+
+        // Fraction of the light reaching hit on obj: 0 or 1 for a point
+        // light. For an area light a few probe rays are traced first, only
+        // if they disagree (penumbra) the rest of its samples follow. The
+        // points on the light are picked with a generator seeded by seed.
+        double shadowFraction(unsigned light, ObjectPtr const &obj, Point const &hit,
+                              uint32_t seed, ShadowCache &shadows);
+
+        // seed for shadowFraction, drawn from rng only for area lights so
+        // the random numbers of scenes with point lights stay the same
+        static uint32_t shadowSeed(Light const &light, Random &rng);
+
+        // adds the diffuse and specular light of a light source at hit,
+        // shadows are not taken into account
+        void lightIntensity(Light const &light, Point const &hit, Vector const &N,
+                            Vector const &V, double weight,
+                            Triple &I_d, Specular &I_s) const;
+
+        // prints the number of shadow rays and the hit rate of the
+        // occluder caches (summed over the threads)
+        static void report(unsigned long long rays, unsigned long long blocked,
+                           unsigned long long hits);
+
+        // builds the acceleration structure and light tree if the scene
+        // changed, for rendering a width x height frame
+        void prepare(unsigned width, unsigned height);
+
+        static std::vector<Span> spans(Image const &img, std::vector<Region> const &regions);
+        static std::vector<Span> unfinished(std::vector<Span> const &spans,
+                                            Checkpoint const &checkpoint);
 };
 
 #endif
@@ -0,0 +1,174 @@
+#include "scenecache.h"
+
+#include "filestamp.h"
+#include "mappedfile.h"
+#include "scenedescription.h"
+
+#include <cstdio>       // rename, remove
+#include <cstring>
+#include <fstream>
+
+using namespace std;
+
+namespace
+{
+    char const CACHE_MAGIC[4] = {'R', 'T', 'S', 'C'};
+    uint32_t const CACHE_VERSION = 3;
+
+    // The cache file consists of this header, followed by the light,
+    // material, object, geometry and geometry object records, the settings
+    // JSON text, the texture paths and the model paths (each path
+    // terminated by a '\0').
+    struct CacheHeader
+    {
+        char magic[4];
+        uint32_t version;
+        FileStamp source;           // the scene file the cache is of
+        uint64_t numLights;
+        uint64_t numMaterials;
+        uint64_t numObjects;
+        uint64_t numTextures;
+        uint64_t numGeometries;
+        uint64_t numGeometryObjects;
+        uint64_t numModels;
+        uint64_t settingsSize;
+        uint64_t texturesSize;
+        uint64_t modelsSize;
+    };
+
+    template <typename Record>
+    char const *readRecords(char const *ptr, uint64_t count, vector<Record> &records)
+    {
+        Record const *begin = reinterpret_cast<Record const *>(ptr);
+        records.assign(begin, begin + count);
+        return ptr + count * sizeof(Record);
+    }
+
+    template <typename Record>
+    void writeRecords(ostream &out, vector<Record> const &records)
+    {
+        out.write(reinterpret_cast<char const *>(records.data()),
+                  records.size() * sizeof(Record));
+    }
+
+    // reads count '\0' terminated strings from [ptr, end), returns false
+    // if there are less
+    bool readStrings(char const *ptr, char const *end, uint64_t count,
+                     vector<string> &strings)
+    {
+        strings.clear();
+        while (ptr < end && strings.size() != count)
+        {
+            strings.push_back(string(ptr));
+            ptr += strings.back().size() + 1;
+        }
+        return strings.size() == count;
+    }
+
+    uint64_t stringsSize(vector<string> const &strings)
+    {
+        uint64_t size = 0;
+        for (string const &str : strings)
+            size += str.size() + 1;
+        return size;
+    }
+}
+
+string SceneCache::cacheName(string const &ifname)
+{
+    return ifname + ".cache";
+}
+
+bool SceneCache::read(string const &ifname, SceneDescription &desc)
+{
+    MappedFile cache(cacheName(ifname));
+    if (!cache.valid() || cache.size() < sizeof(CacheHeader))
+        return false;
+
+    char const *data = cache.data();
+    CacheHeader header;
+    memcpy(&header, data, sizeof(CacheHeader));
+
+    size_t const expected = sizeof(CacheHeader)
+                          + header.numLights * sizeof(LightRecord)
+                          + header.numMaterials * sizeof(MaterialRecord)
+                          + header.numObjects * sizeof(ObjectRecord)
+                          + header.numGeometries * sizeof(GeometryRecord)
+                          + header.numGeometryObjects * sizeof(ObjectRecord)
+                          + header.settingsSize + header.texturesSize + header.modelsSize;
+
+    bool valid = memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0
+              && header.version == CACHE_VERSION
+              && expected == cache.size()
+              && header.source.matches(ifname);
+
+    if (valid)
+    {
+        char const *ptr = data + sizeof(CacheHeader);
+        ptr = readRecords(ptr, header.numLights, desc.lights);
+        ptr = readRecords(ptr, header.numMaterials, desc.materials);
+        ptr = readRecords(ptr, header.numObjects, desc.objects);
+        ptr = readRecords(ptr, header.numGeometries, desc.geometries);
+        ptr = readRecords(ptr, header.numGeometryObjects, desc.geometryObjects);
+
+        desc.settings.assign(ptr, header.settingsSize);
+        ptr += header.settingsSize;
+
+        valid = readStrings(ptr, ptr + header.texturesSize, header.numTextures, desc.textures)
+             && readStrings(ptr + header.texturesSize,
+                            ptr + header.texturesSize + header.modelsSize,
+                            header.numModels, desc.models);
+    }
+
+    return valid;
+}
+
+bool SceneCache::write(string const &ifname, SceneDescription const &desc)
+{
+    CacheHeader header {};
+    memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = CACHE_VERSION;
+    if (!header.source.read(ifname))
+        return false;
+
+    header.numLights = desc.lights.size();
+    header.numMaterials = desc.materials.size();
+    header.numObjects = desc.objects.size();
+    header.numTextures = desc.textures.size();
+    header.numGeometries = desc.geometries.size();
+    header.numGeometryObjects = desc.geometryObjects.size();
+    header.numModels = desc.models.size();
+    header.settingsSize = desc.settings.size();
+    header.texturesSize = stringsSize(desc.textures);
+    header.modelsSize = stringsSize(desc.models);
+
+    // write to a temporary file first, so other processes never see a
+    // partially written cache
+    string const cname = cacheName(ifname);
+    string const tmpname = cname + ".tmp";
+    {
+        ofstream outfile(tmpname, ios::binary | ios::trunc);
+        if (!outfile)
+            return false;
+
+        outfile.write(reinterpret_cast<char const *>(&header), sizeof(CacheHeader));
+        writeRecords(outfile, desc.lights);
+        writeRecords(outfile, desc.materials);
+        writeRecords(outfile, desc.objects);
+        writeRecords(outfile, desc.geometries);
+        writeRecords(outfile, desc.geometryObjects);
+        outfile.write(desc.settings.data(), desc.settings.size());
+        for (string const &texture : desc.textures)
+            outfile.write(texture.c_str(), texture.size() + 1);
+        for (string const &model : desc.models)
+            outfile.write(model.c_str(), model.size() + 1);
+
+        if (!outfile)
+        {
+            outfile.close();
+            remove(tmpname.c_str());
+            return false;
+        }
+    }
+    return rename(tmpname.c_str(), cname.c_str()) == 0;
+}
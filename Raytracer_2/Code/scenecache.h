@@ -0,0 +1,29 @@
+#ifndef SCENECACHE_H_
+#define SCENECACHE_H_
+
+#include <string>
+
+// Forward declerations
+class SceneDescription;
+
+/**
+ * Binary cache of a parsed scene file. After parsing the JSON scene it
+ * is written next to the scene file (scene.json -> scene.json.cache).
+ * Later runs memory-map the cache instead of parsing the JSON again.
+ * The cache stores the size, modification time and hash of the scene
+ * file it was created from and is ignored when the scene file changed.
+ */
+class SceneCache
+{
+    public:
+
+        static std::string cacheName(std::string const &ifname);
+
+        // returns false if there is no valid cache for the scene file
+        static bool read(std::string const &ifname, SceneDescription &desc);
+
+        // returns false if the cache could not be written
+        static bool write(std::string const &ifname, SceneDescription const &desc);
+};
+
+#endif
@@ -0,0 +1,72 @@
+#include "scenedescription.h"
+
+#include <stdexcept>
+
+using namespace std;
+
+uint32_t SceneDescription::addMaterial(MaterialRecord const &material)
+{
+    // many objects share the same material, so store it only once. The
+    // records are POD and zero initialized, so the raw bytes are the key.
+    string key(reinterpret_cast<char const *>(&material), sizeof(MaterialRecord));
+    auto found = d_materialIndex.find(key);
+    if (found != d_materialIndex.end())
+        return found->second;
+
+    materials.push_back(material);
+    d_materialIndex[key] = materials.size() - 1;
+    return materials.size() - 1;
+}
+
+int32_t SceneDescription::addTexture(string const &path)
+{
+    auto found = d_textureIndex.find(path);
+    if (found != d_textureIndex.end())
+        return found->second;
+
+    textures.push_back(path);
+    d_textureIndex[path] = textures.size() - 1;
+    return textures.size() - 1;
+}
+
+uint32_t SceneDescription::geometryIndex(string const &name)
+{
+    auto found = d_geometryIndex.find(name);
+    if (found != d_geometryIndex.end())
+        return found->second;
+
+    geometries.push_back(GeometryRecord{0, 0, -1, -1});
+    d_geometryDefined.push_back(false);
+    d_geometryIndex[name] = geometries.size() - 1;
+    return geometries.size() - 1;
+}
+
+void SceneDescription::defineGeometry(string const &name, GeometryRecord const &geometry)
+{
+    uint32_t idx = geometryIndex(name);
+    if (d_geometryDefined[idx])
+        throw runtime_error("Geometry defined twice: " + name);
+
+    geometries[idx] = geometry;
+    d_geometryDefined[idx] = true;
+}
+
+void SceneDescription::resolveInstances()
+{
+    for (auto const &entry : d_geometryIndex)
+    {
+        if (!d_geometryDefined[entry.second])
+            throw runtime_error("Unknown geometry: " + entry.first);
+    }
+
+    for (ObjectRecord &record : objects)
+    {
+        if (record.type != OBJECT_INSTANCE || record.material != GEOMETRY_MATERIAL)
+            continue;
+
+        int32_t material = geometries[record.geometry].material;
+        if (material < 0)
+            throw runtime_error("Instance without material of a geometry without material");
+        record.material = material;
+    }
+}
@@ -0,0 +1,109 @@
+#ifndef SCENEDESCRIPTION_H_
+#define SCENEDESCRIPTION_H_
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Flat description of a parsed scene. The JSON parser fills it in, the
+ * binary scene cache stores it as is and the Raytracer builds the actual
+ * Scene from it. All records are plain old data so they can be written
+ * to and read from disk with a single memcpy.
+ */
+
+enum ObjectType : uint32_t
+{
+    OBJECT_SPHERE,
+    OBJECT_TRIANGLE,
+    OBJECT_PLANE,
+    OBJECT_QUAD,
+    OBJECT_INSTANCE
+};
+
+// material index of an instance that uses the material of its geometry
+uint32_t const GEOMETRY_MATERIAL = UINT32_MAX;
+
+struct ObjectRecord
+{
+    uint32_t type;          // ObjectType
+    uint32_t material;      // index into SceneDescription::materials
+    uint32_t geometry;      // instances: index into SceneDescription::geometries
+    uint32_t padding;
+    double params[12];      // shape parameters, layout depends on type:
+                            //  sphere:   position, radius, rotation, angle
+                            //  triangle: vertex1, vertex2, vertex3
+                            //  plane:    a, b, c, d
+                            //  quad:     vertex1, vertex2, vertex3, vertex4
+                            //  instance: rows of the 3x4 transformation
+};
+
+// a named geometry that instances share: a number of shapes and/or the
+// triangles of a model file, in object space
+struct GeometryRecord
+{
+    uint32_t firstObject;   // range in SceneDescription::geometryObjects
+    uint32_t numObjects;
+    int32_t model;          // index into SceneDescription::models, or -1
+    int32_t material;       // default material of the instances, or -1
+};
+
+struct MaterialRecord
+{
+    double color[3];
+    double ka;
+    double kd;
+    double ks;
+    double n;
+    int32_t texture;        // index into SceneDescription::textures, -1
+                            // if the material has a plain color
+    uint32_t padding;
+};
+
+struct LightRecord
+{
+    double position[3];
+    double color[3];
+    uint32_t shape;         // Light::Shape
+    uint32_t samples;       // shadow rays of area lights
+    double edge1[3];        // rectangle
+    double edge2[3];
+    double radius;          // sphere
+};
+
+class SceneDescription
+{
+    // lookup tables used to find duplicate materials and textures
+    std::unordered_map<std::string, uint32_t> d_materialIndex;
+    std::unordered_map<std::string, int32_t> d_textureIndex;
+    std::unordered_map<std::string, uint32_t> d_geometryIndex;
+    std::vector<bool> d_geometryDefined;
+
+    public:
+        std::string settings;   // JSON text of the scene settings (all
+                                // top level entries but Lights/Objects)
+        std::vector<LightRecord> lights;
+        std::vector<MaterialRecord> materials;
+        std::vector<ObjectRecord> objects;
+        std::vector<std::string> textures;  // paths of the texture images
+        std::vector<GeometryRecord> geometries;
+        std::vector<ObjectRecord> geometryObjects;
+        std::vector<std::string> models;    // paths of the .obj files
+
+        // add a material or texture, returns the index of an identical
+        // entry if there already is one
+        uint32_t addMaterial(MaterialRecord const &material);
+        int32_t addTexture(std::string const &path);
+
+        // index of the named geometry. Instances may refer to a geometry
+        // before it is defined, so the index is reserved on first use.
+        uint32_t geometryIndex(std::string const &name);
+        void defineGeometry(std::string const &name, GeometryRecord const &geometry);
+
+        // throws runtime_error if a geometry is used but never defined, and
+        // gives instances without a material the one of their geometry
+        void resolveInstances();
+};
+
+#endif
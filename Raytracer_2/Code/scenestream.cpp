@@ -0,0 +1,204 @@
+#include "scenestream.h"
+
+#include <cctype>
+#include <stdexcept>
+
+using namespace std;
+
+SceneStream::SceneStream(string const &filename)
+:
+    d_in(filename, ios::binary),
+    d_buffer(1 << 16),
+    d_pos(0),
+    d_end(0)
+{
+    if (!d_in) throw runtime_error("Could not open input file for reading.");
+}
+
+void SceneStream::parse(MemberHandler const &onMember, ObjectsHandler const &onObjects,
+                        size_t batchSize)
+{
+    skipWhitespace();
+    expect('{');
+    skipWhitespace();
+    if (peek() == '}')
+        return;
+
+    vector<string> batch;
+    string value;
+    while (true)
+    {
+        skipWhitespace();
+        string key = readKey();
+        skipWhitespace();
+        expect(':');
+        skipWhitespace();
+
+        if (key == "Objects")
+        {
+            // hand out the array elements in batches
+            expect('[');
+            skipWhitespace();
+            if (peek() == ']')
+                get();
+            else
+            {
+                while (true)
+                {
+                    skipWhitespace();
+                    batch.push_back(string());
+                    readValue(batch.back());
+                    if (batch.size() == batchSize)
+                    {
+                        onObjects(batch);
+                        batch.clear();
+                    }
+
+                    skipWhitespace();
+                    int ch = get();
+                    if (ch == ']')
+                        break;
+                    if (ch != ',')
+                        throw runtime_error("SceneStream: expected ',' or ']' in \"Objects\"");
+                }
+            }
+            if (!batch.empty())
+                onObjects(batch);
+            batch.clear();
+        }
+        else
+        {
+            value.clear();
+            readValue(value);
+            onMember(key, value);
+        }
+
+        skipWhitespace();
+        int ch = get();
+        if (ch == '}')
+            break;
+        if (ch != ',')
+            throw runtime_error("SceneStream: expected ',' or '}' after a scene entry");
+    }
+}
+
+// --- Private -----------------------------------------------------------------
+
+int SceneStream::peek()
+{
+    if (d_pos == d_end)
+    {
+        d_in.read(d_buffer.data(), d_buffer.size());
+        d_pos = 0;
+        d_end = d_in.gcount();
+        if (d_end == 0)
+            return EOF;
+    }
+    return static_cast<unsigned char>(d_buffer[d_pos]);
+}
+
+int SceneStream::get()
+{
+    int ch = peek();
+    if (ch != EOF)
+        ++d_pos;
+    return ch;
+}
+
+void SceneStream::expect(char ch)
+{
+    if (get() != ch)
+        throw runtime_error(string("SceneStream: expected '") + ch + "'");
+}
+
+void SceneStream::skipWhitespace()
+{
+    while (isspace(peek()))
+        get();
+}
+
+string SceneStream::readKey()
+{
+    string text;
+    readString(text);
+    // keys of the scene file do not contain escapes, strip the quotes
+    return text.substr(1, text.size() - 2);
+}
+
+// Appends the JSON text of the next value. Objects and arrays are copied up
+// to their matching closing bracket, brackets inside strings are ignored.
+void SceneStream::readValue(string &text)
+{
+    int ch = peek();
+    if (ch == '"')
+    {
+        readString(text);
+        return;
+    }
+
+    if (ch != '{' && ch != '[')
+    {
+        // number, true, false or null
+        while ((ch = peek()) != EOF && ch != ',' && ch != '}' && ch != ']' && !isspace(ch))
+            text += static_cast<char>(get());
+        if (text.empty())
+            throw runtime_error("SceneStream: expected a value");
+        return;
+    }
+
+    // scan the buffer directly and append whole runs of characters, this
+    // is where all the time of reading a large scene goes
+    unsigned depth = 0;
+    bool inString = false;
+    bool escaped = false;
+    while (true)
+    {
+        if (peek() == EOF)
+            throw runtime_error("SceneStream: unexpected end of file");
+
+        size_t start = d_pos;
+        while (d_pos != d_end)
+        {
+            char ch = d_buffer[d_pos++];
+            if (inString)
+            {
+                if (escaped)
+                    escaped = false;
+                else if (ch == '\\')
+                    escaped = true;
+                else if (ch == '"')
+                    inString = false;
+            }
+            else if (ch == '"')
+                inString = true;
+            else if (ch == '{' || ch == '[')
+                ++depth;
+            else if ((ch == '}' || ch == ']') && --depth == 0)
+            {
+                text.append(&d_buffer[start], d_pos - start);
+                return;
+            }
+        }
+        text.append(&d_buffer[start], d_pos - start);
+    }
+}
+
+void SceneStream::readString(string &text)
+{
+    if (peek() != '"')
+        throw runtime_error("SceneStream: expected a string");
+    text += static_cast<char>(get());
+
+    while (true)
+    {
+        int ch = get();
+        if (ch == EOF)
+            throw runtime_error("SceneStream: unexpected end of file in string");
+
+        text += static_cast<char>(ch);
+        if (ch == '\\')
+            text += static_cast<char>(get());    // escaped character
+        else if (ch == '"')
+            break;
+    }
+}
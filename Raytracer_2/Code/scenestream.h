@@ -0,0 +1,50 @@
+#ifndef SCENESTREAM_H_
+#define SCENESTREAM_H_
+
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * Streaming reader for JSON scene files. Instead of building the DOM of
+ * the whole file, the elements of the top level "Objects" array are handed
+ * out in batches of their JSON text, so only one batch is in memory at a
+ * time. All other top level entries (settings, lights) are small and are
+ * handed out as key / JSON text pairs.
+ *
+ * The reader only finds the boundaries of the values, the values
+ * themselves are parsed by the caller (nlohmann::json).
+ */
+class SceneStream
+{
+    std::ifstream d_in;
+    std::vector<char> d_buffer;
+    size_t d_pos;
+    size_t d_end;
+
+    public:
+
+        typedef std::function<void(std::string const &key,
+                                   std::string const &value)> MemberHandler;
+        typedef std::function<void(std::vector<std::string> const &objects)> ObjectsHandler;
+
+        explicit SceneStream(std::string const &filename);
+
+        // reads the whole file, throws runtime_error on syntax errors
+        void parse(MemberHandler const &onMember, ObjectsHandler const &onObjects,
+                   size_t batchSize = 4096);
+
+    private:
+
+        int peek();
+        int get();
+        void expect(char ch);
+        void skipWhitespace();
+
+        std::string readKey();
+        void readValue(std::string &text);
+        void readString(std::string &text);
+};
+
+#endif
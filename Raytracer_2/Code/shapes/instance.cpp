@@ -0,0 +1,146 @@
+#include "instance.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+using namespace std;
+
+namespace
+{
+    Point transformPoint(double const *m, Point const &p)
+    {
+        return Point(m[0] * p.x + m[1] * p.y + m[2]  * p.z + m[3],
+                     m[4] * p.x + m[5] * p.y + m[6]  * p.z + m[7],
+                     m[8] * p.x + m[9] * p.y + m[10] * p.z + m[11]);
+    }
+
+    Vector transformVector(double const *m, Vector const &v)
+    {
+        return Vector(m[0] * v.x + m[1] * v.y + m[2]  * v.z,
+                      m[4] * v.x + m[5] * v.y + m[6]  * v.z,
+                      m[8] * v.x + m[9] * v.y + m[10] * v.z);
+    }
+
+    // multiplies with the transpose of the 3x3 part
+    Vector transformTransposed(double const *m, Vector const &v)
+    {
+        return Vector(m[0] * v.x + m[4] * v.y + m[8]  * v.z,
+                      m[1] * v.x + m[5] * v.y + m[9]  * v.z,
+                      m[2] * v.x + m[6] * v.y + m[10] * v.z);
+    }
+}
+
+Hit Instance::intersect(Ray const &ray)
+{
+    Hit hit;
+    distance(ray, hit);
+    if (isnan(hit.t))
+        return Hit::NO_HIT();
+    attributes(ray, hit);
+    return hit;
+}
+
+void Instance::distance(Ray const &ray, Hit &hit)
+{
+    double scale;
+    Ray local = localRay(ray, scale);
+
+    Hit inner;
+    int idx = d_geometry->closest(local, inner);
+    hit.t = idx < 0 ? numeric_limits<double>::quiet_NaN() : inner.t / scale;
+    hit.primitive = idx < 0 ? 0 : idx;
+}
+
+void Instance::attributes(Ray const &ray, Hit &hit)
+{
+    // only the closest hit gets here, so the shape that was hit is simply
+    // intersected again
+    double scale;
+    Ray local = localRay(ray, scale);
+
+    ObjectPtr const &obj = d_geometry->object(hit.primitive);
+    Hit inner;
+    obj->distance(local, inner);
+    obj->attributes(local, inner);
+
+    // normals transform with the inverse transpose
+    hit.N = transformTransposed(d_inverse, inner.N).normalized();
+    hit.b1 = inner.b1;
+    hit.b2 = inner.b2;
+}
+
+std::tuple<float, float> Instance::pointMapping(Triple p)
+{
+    // p is a direction like a normal, map it as the first shape of the
+    // geometry does in object space
+    return d_geometry->object(0)->pointMapping(transformTransposed(d_matrix, p).normalized());
+}
+
+Ray Instance::localRay(Ray const &ray, double &scale) const
+{
+    // the shapes expect a unit direction, so the distance in object space
+    // is scaled back by the length of the transformed direction
+    Vector D = transformVector(d_inverse, ray.D);
+    scale = D.length();
+    return Ray(transformPoint(d_inverse, ray.O), D / scale);
+}
+
+bool Instance::bounds(Point &min, Point &max)
+{
+    min = d_min;
+    max = d_max;
+    return d_bounded;
+}
+
+Instance::Instance(std::shared_ptr<BVH const> const &geometry, double const matrix[12])
+:
+    d_geometry(geometry),
+    d_bounded(false)
+{
+    copy(matrix, matrix + 12, d_matrix);
+
+    // inverse of the 3x3 part by the adjugate, the translation follows
+    double const *m = d_matrix;
+    double adjugate[9] = {
+        m[5] * m[10] - m[6] * m[9],  m[2] * m[9] - m[1] * m[10], m[1] * m[6] - m[2] * m[5],
+        m[6] * m[8]  - m[4] * m[10], m[0] * m[10] - m[2] * m[8], m[2] * m[4] - m[0] * m[6],
+        m[4] * m[9]  - m[5] * m[8],  m[1] * m[8] - m[0] * m[9],  m[0] * m[5] - m[1] * m[4]
+    };
+    double det = m[0] * adjugate[0] + m[1] * adjugate[3] + m[2] * adjugate[6];
+    if (fabs(det) < 1e-12)
+        throw runtime_error("Instance: the transform can not be inverted");
+
+    for (unsigned row = 0; row != 3; ++row)
+    {
+        for (unsigned col = 0; col != 3; ++col)
+            d_inverse[4 * row + col] = adjugate[3 * row + col] / det;
+        d_inverse[4 * row + 3] = 0.0;
+    }
+    Vector translation = transformVector(d_inverse, Vector(m[3], m[7], m[11]));
+    d_inverse[3] = -translation.x;
+    d_inverse[7] = -translation.y;
+    d_inverse[11] = -translation.z;
+
+    // world space box around the transformed corners of the object box
+    Point localMin, localMax;
+    if (!d_geometry->bounds(localMin, localMax))
+        return;
+
+    d_bounded = true;
+    for (unsigned corner = 0; corner != 8; ++corner)
+    {
+        Point p(corner & 1 ? localMax.x : localMin.x,
+                corner & 2 ? localMax.y : localMin.y,
+                corner & 4 ? localMax.z : localMin.z);
+        p = transformPoint(d_matrix, p);
+        if (corner == 0)
+            d_min = d_max = p;
+        for (unsigned axis = 0; axis != 3; ++axis)
+        {
+            d_min.data[axis] = std::min(d_min.data[axis], p.data[axis]);
+            d_max.data[axis] = std::max(d_max.data[axis], p.data[axis]);
+        }
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef INSTANCE_H_
+#define INSTANCE_H_
+
+#include "../bvh.h"
+#include "../object.h"
+#include "../triple.h"
+
+#include <memory>
+#include <tuple>
+
+/**
+ * A placed copy of a shared geometry (see "Geometries" in the scene
+ * file). Only the transformation and the material index are stored per
+ * instance, the geometry itself (and its BVH) is shared. Rays are
+ * transformed into object space when intersecting.
+ */
+class Instance: public Object
+{
+    std::shared_ptr<BVH const> d_geometry;
+    double d_matrix[12];        // object to world, rows of a 3x4 matrix
+    double d_inverse[12];       // world to object
+    Point d_min;                // world space bounding box
+    Point d_max;
+    bool d_bounded;
+
+    public:
+        // throws runtime_error if the matrix can not be inverted
+        Instance(std::shared_ptr<BVH const> const &geometry, double const matrix[12]);
+
+        virtual Hit intersect(Ray const &ray);
+        virtual void distance(Ray const &ray, Hit &hit);
+        virtual void attributes(Ray const &ray, Hit &hit);
+        virtual std::tuple<float, float> pointMapping(Triple p);
+        virtual bool bounds(Point &min, Point &max);
+
+    private:
+        // the ray in object space and the factor from object to world
+        // distances
+        Ray localRay(Ray const &ray, double &scale) const;
+};
+
+#endif
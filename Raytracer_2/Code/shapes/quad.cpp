@@ -1,48 +1,37 @@
 #include "quad.h"
 #include "triangle.h"
 
+#include <algorithm>
 #include <cmath>
 
 using namespace std;
 
 Hit Quad::intersect(Ray const &ray)
 {
-    /**
-     * In order to draw a quad, we divide the quad into 2 triangles and compute the intersection
-     * To find out which vertices we need for the 2 triangles we take the vertex 1 and compute which
-     * vertex lies farthest from vertex 1. We will make a triangle not including this point and we will
-     * make a second triangle including this point and the two vertices which lie nearest to it.
-     */
-    Triangle t1 = Triangle(v1, v2, v3);
-    Triangle t2 = Triangle(v1, v2, v3);
-
-    Point furthest_v1 = furthest_point(v1, v2, v3, v4);
-
-    t1 = take_nearest(furthest_v1, v1, v2, v3, v4);
-
-    if(furthest_v1.equals(v2)){
-        Point furthest_v2 = furthest_point(v2, v1, v3, v4);
-        t2 = take_nearest(furthest_v2, v2, v1, v3, v4);
-    } else if(furthest_v1.equals(v3)){
-        Point furthest_v3 = furthest_point(v3, v1, v2, v4);
-        t2 = take_nearest(furthest_v3, v3, v1, v2, v4);
-    } else {
-        Point furthest_v4 = furthest_point(v4, v1, v2, v3);
-        t2 = take_nearest(furthest_v4, v4, v1, v2, v3);
-    }
-
-    Hit h1 = t1.intersect(ray);
-    Hit h2 = t2.intersect(ray);
+    Hit hit;
+    distance(ray, hit);
+    if (isnan(hit.t))
+        return Hit::NO_HIT();
+    attributes(ray, hit);
+    return hit;
+}
 
+void Quad::distance(Ray const &ray, Hit &hit)
+{
     //Find out if t1 or t2 is being hit by the light
-    if ( !isnan(h1.t)) {
-        return h1;
-    }
-    if ( !isnan(h2.t)) {
-        return h2;
+    for (unsigned idx = 0; idx != 2; ++idx)
+    {
+        d_triangles[idx].distance(ray, hit);
+        if (!isnan(hit.t)) {
+            hit.primitive = idx;
+            return;
+        }
     }
+}
 
-    return Hit::NO_HIT();
+void Quad::attributes(Ray const &ray, Hit &hit)
+{
+    d_triangles[hit.primitive].attributes(ray, hit);
 }
 
 //furthest_point takes 4 points as input and computes which of point lies furthest from the first given point
@@ -85,9 +74,42 @@ std::tuple<float, float> Quad::pointMapping(Triple p) {
     }
 }
 
+bool Quad::bounds(Point &min, Point &max)
+{
+    for (unsigned axis = 0; axis != 3; ++axis)
+    {
+        min.data[axis] = std::min({v1.data[axis], v2.data[axis], v3.data[axis], v4.data[axis]});
+        max.data[axis] = std::max({v1.data[axis], v2.data[axis], v3.data[axis], v4.data[axis]});
+    }
+    return true;
+}
+
 Quad::Quad(Point const &v1, Point const &v2, Point const &v3, Point const &v4)
 : v1(v1),
   v2(v2),
   v3(v3),
-  v4(v4)
-{}
+  v4(v4),
+  d_triangles{Triangle(v1, v2, v3), Triangle(v1, v2, v3)}
+{
+    /**
+     * In order to draw a quad, we divide the quad into 2 triangles and compute the intersection
+     * To find out which vertices we need for the 2 triangles we take the vertex 1 and compute which
+     * vertex lies farthest from vertex 1. We will make a triangle not including this point and we will
+     * make a second triangle including this point and the two vertices which lie nearest to it.
+     * The split only depends on the vertices, so it is done once here.
+     */
+    Point furthest_v1 = furthest_point(v1, v2, v3, v4);
+
+    d_triangles[0] = take_nearest(furthest_v1, v1, v2, v3, v4);
+
+    if(furthest_v1.equals(v2)){
+        Point furthest_v2 = furthest_point(v2, v1, v3, v4);
+        d_triangles[1] = take_nearest(furthest_v2, v2, v1, v3, v4);
+    } else if(furthest_v1.equals(v3)){
+        Point furthest_v3 = furthest_point(v3, v1, v2, v4);
+        d_triangles[1] = take_nearest(furthest_v3, v3, v1, v2, v4);
+    } else {
+        Point furthest_v4 = furthest_point(v4, v1, v2, v3);
+        d_triangles[1] = take_nearest(furthest_v4, v4, v1, v2, v3);
+    }
+}
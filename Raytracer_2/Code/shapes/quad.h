@@ -16,12 +16,18 @@ class Quad: public Object
         Triangle take_nearest(Point furthest, Point triangle_point, Point p1, Point p2, Point p3);
 
         virtual Hit intersect(Ray const &ray);
+        virtual void distance(Ray const &ray, Hit &hit);
+        virtual void attributes(Ray const &ray, Hit &hit);
         virtual std::tuple<float, float> pointMapping(Triple p);
+        virtual bool bounds(Point &min, Point &max);
 
         Point const v1;
         Point const v2;
         Point const v3;
         Point const v4;
+
+    private:
+        Triangle d_triangles[2];    // the quad split in two, see the constructor
 };
 
 #endif
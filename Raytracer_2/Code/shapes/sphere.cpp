@@ -1,11 +1,24 @@
 #include "sphere.h"
-#include <tuple>
+
+#include "../fastmath.h"
 
 #include <cmath>
+#include <limits>
+#include <tuple>
 
 using namespace std;
 
 Hit Sphere::intersect(Ray const &ray)
+{
+    Hit hit;
+    distance(ray, hit);
+    if (isnan(hit.t))
+        return Hit::NO_HIT();
+    attributes(ray, hit);
+    return hit;
+}
+
+void Sphere::distance(Ray const &ray, Hit &hit)
 {
     //INTERSECTION CALCULATION
     double t;
@@ -16,7 +29,8 @@ Hit Sphere::intersect(Ray const &ray)
     double discriminant = term1*term1 - term2 + r*r;
 
     if (discriminant < 0) {
-        return Hit::NO_HIT();
+        hit.t = numeric_limits<double>::quiet_NaN();
+        return;
     }
 
     //find out which hit point is closest and in front of eye
@@ -26,32 +40,65 @@ Hit Sphere::intersect(Ray const &ray)
     if (t < 0){
         t = max(t1, t2);
     }
+    hit.t = t;
+}
 
+void Sphere::attributes(Ray const &ray, Hit &hit)
+{
     //NORMAL CALCULATION
 
-    Triple intersection = ray.O +(ray.D * t);
-    Vector N = intersection - center;
+    Triple intersection = ray.O +(ray.D * hit.t);
+    Vector N = intersection - position;
     N.normalize();
-
-    return Hit(t,N);
+    hit.N = N;
 }
 
 std::tuple<float, float> Sphere::pointMapping(Triple p) {
-    Triple rotation = rot.normalized();
-    float angle = a * M_PI / 180; //in radians
-    //according to Rodrigues' rotation formula
-    Triple rotated = p * cos(angle) + rotation.cross(p) * sin(angle) + rotation * (rotation.dot(p)) * (1 - cos(angle));
+    //the rotation matrix of the texture is made once, in the constructor
+    double const *m = d_rotation;
+    Triple rotated(m[0] * p.x + m[1] * p.y + m[2] * p.z,
+                   m[3] * p.x + m[4] * p.y + m[5] * p.z,
+                   m[6] * p.x + m[7] * p.y + m[8] * p.z);
 
     p = rotated.normalized();
+    if (d_fastMath) {
+        float u = 0.5f + FastMath::atan2(p.y, p.x) * static_cast<float>(0.5 / M_PI);
+        float v = 0.5f + FastMath::asin(p.z) * static_cast<float>(1 / M_PI);
+        return std::make_tuple(u,v);
+    }
     float u = 0.5 + atan2(p.y,p.x) / (2*M_PI);
     float v = 0.5 + asin(p.z) / M_PI;
     return std::make_tuple(u,v);
 }
 
-Sphere::Sphere(Point const &pos, double radius, Point rotation, float angle)
+bool Sphere::bounds(Point &min, Point &max)
+{
+    min = position - r;
+    max = position + r;
+    return true;
+}
+
+Sphere::Sphere(Point const &pos, double radius, Point rotation, float angle, bool fastMath)
 :
     position(pos),
     r(radius),
     rot(rotation),
-    a(angle)
-{}
+    a(angle),
+    d_fastMath(fastMath)
+{
+    //according to Rodrigues' rotation formula, the rotation of p is
+    //p cos + (k x p) sin + k (k . p) (1 - cos) for the unit axis k
+    Triple k = rot.normalized();
+    float radians = a * M_PI / 180;
+    double c = cos(radians);
+    double s = sin(radians);
+    double cross[9] = {   0, -k.z,  k.y,
+                        k.z,    0, -k.x,
+                       -k.y,  k.x,    0};
+    for (unsigned row = 0; row != 3; ++row)
+    {
+        for (unsigned col = 0; col != 3; ++col)
+            d_rotation[3 * row + col] = (row == col ? c : 0.0) + cross[3 * row + col] * s
+                                      + k.data[row] * k.data[col] * (1 - c);
+    }
+}
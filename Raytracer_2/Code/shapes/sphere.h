@@ -10,15 +10,25 @@ using namespace std;
 class Sphere: public Object
 {
     public:
-        Sphere(Point const &pos, double radius, Point rotation, float angle);
+        // with fastMath the texture coordinates use the FastMath
+        // approximations of atan2 and asin
+        Sphere(Point const &pos, double radius, Point rotation, float angle,
+               bool fastMath = false);
 
         virtual Hit intersect(Ray const &ray);
+        virtual void distance(Ray const &ray, Hit &hit);
+        virtual void attributes(Ray const &ray, Hit &hit);
         virtual std::tuple<float, float> pointMapping(Triple p);
+        virtual bool bounds(Point &min, Point &max);
 
         Point const position;
         double const r;
         Point const rot;
         float const a;
+
+    private:
+        double d_rotation[9];   // texture rotation (rot, a) as a 3x3 matrix
+        bool d_fastMath;
 };
 
 #endif
@@ -1,10 +1,22 @@
 #include "triangle.h"
 
+#include <algorithm>
 #include <cmath>
+#include <limits>
 
 using namespace std;
 
 Hit Triangle::intersect(Ray const &ray)
+{
+    Hit hit;
+    distance(ray, hit);
+    if (isnan(hit.t))
+        return Hit::NO_HIT();
+    attributes(ray, hit);
+    return hit;
+}
+
+void Triangle::distance(Ray const &ray, Hit &hit)
 {
     Triple ray_origin = ray.O;
     Triple ray_direction = ray.D;
@@ -17,38 +29,45 @@ Hit Triangle::intersect(Ray const &ray)
     h = ray_direction.cross(edge2);
     a = edge1.dot(h);
 
-    Triple N = edge1.cross(edge2);
-    N.normalize();
+    hit.t = numeric_limits<double>::quiet_NaN();
 
     //ray and triangle are parallel
     if (a > -EPSILON && a < EPSILON)
-        return Hit::NO_HIT();
+        return;
 
     f = 1/a;
     s = ray_origin - vertex1;
     u = f * (s.dot(h));
     if (u < 0.0 || u > 1.0)
-        return Hit::NO_HIT();
+        return;
 
     q = s.cross(edge1);
     v = f * ray_direction.dot(q);
     if (v < 0.0 || u + v > 1.0)
-        return Hit::NO_HIT();
+        return;
 
     // At this stage we can compute t to find out where the intersection point is on the line.
     double t = f * edge2.dot(q);
 
     if (t > EPSILON) // ray intersection
     {
-        //The degree between the normal and the vector ray direction should be larger than 90 degrees
-        if (N.dot(ray_direction) > 0) {
-            N = Triple(-1,-1,-1) * N;
-        }
+        hit.t = t;
+        hit.b1 = u;
+        hit.b2 = v;
+    }
+    // else there is a line intersection but not a ray intersection.
+}
 
-        return Hit(t,N);
+void Triangle::attributes(Ray const &ray, Hit &hit)
+{
+    Triple N = (vertex2 - vertex1).cross(vertex3 - vertex1);
+    N.normalize();
+
+    //The degree between the normal and the vector ray direction should be larger than 90 degrees
+    if (N.dot(ray.D) > 0) {
+        N = Triple(-1,-1,-1) * N;
     }
-    else // This means that there is a line intersection but not a ray intersection.
-        return Hit::NO_HIT();
+    hit.N = N;
 }
 
 std::tuple<float, float> Triangle::pointMapping(Triple p) {
@@ -60,6 +79,16 @@ std::tuple<float, float> Triangle::pointMapping(Triple p) {
     }
 }
 
+bool Triangle::bounds(Point &min, Point &max)
+{
+    for (unsigned axis = 0; axis != 3; ++axis)
+    {
+        min.data[axis] = std::min({vertex1.data[axis], vertex2.data[axis], vertex3.data[axis]});
+        max.data[axis] = std::max({vertex1.data[axis], vertex2.data[axis], vertex3.data[axis]});
+    }
+    return true;
+}
+
 Triangle::Triangle(Point const &v1, Point const &v2, Point const &v3)
 :
     vertex1(v1),
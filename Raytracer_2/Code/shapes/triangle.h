@@ -13,7 +13,10 @@ class Triangle: public Object
         Triangle(Point const &v1, Point const &v2, Point const &v3);
 
         virtual Hit intersect(Ray const &ray);
+        virtual void distance(Ray const &ray, Hit &hit);
+        virtual void attributes(Ray const &ray, Hit &hit);
         virtual std::tuple<float, float> pointMapping(Triple p);
+        virtual bool bounds(Point &min, Point &max);
 
         Point vertex1;
         Point vertex2;
@@ -0,0 +1,212 @@
+#include "socket.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace
+{
+    bool isUnix(string const &address, sockaddr_un &addr)
+    {
+        if (address.compare(0, 5, "unix:") != 0)
+            return false;
+
+        string const path = address.substr(5);
+        if (path.size() >= sizeof(addr.sun_path))
+            throw runtime_error("Socket path too long: " + path);
+
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, path.c_str());
+        return true;
+    }
+
+    addrinfo *resolve(string const &address, bool passive)
+    {
+        size_t colon = address.find_last_of(':');
+        if (colon == string::npos)
+            throw runtime_error("Expected host:port or unix:path, got " + address);
+
+        string const host = address.substr(0, colon);
+        string const port = address.substr(colon + 1);
+
+        addrinfo hints {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = passive ? AI_PASSIVE : 0;
+
+        addrinfo *result;
+        int status = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(),
+                                 &hints, &result);
+        if (status != 0)
+            throw runtime_error("Could not resolve " + address + ": " + gai_strerror(status));
+        return result;
+    }
+
+    void noDelay(int fd)
+    {
+        // tiles are small messages, send them right away
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+}
+
+Socket::Socket()
+:
+    d_fd(-1)
+{}
+
+Socket::Socket(int fd)
+:
+    d_fd(fd)
+{}
+
+Socket::~Socket()
+{
+    close();
+}
+
+Socket::Socket(Socket &&other)
+:
+    d_fd(other.d_fd)
+{
+    other.d_fd = -1;
+}
+
+Socket &Socket::operator=(Socket &&other)
+{
+    if (this != &other)
+    {
+        close();
+        d_fd = other.d_fd;
+        other.d_fd = -1;
+    }
+    return *this;
+}
+
+Socket Socket::listen(string const &address)
+{
+    sockaddr_un unixAddr;
+    if (isUnix(address, unixAddr))
+    {
+        unlink(unixAddr.sun_path);      // left behind by an earlier run
+        Socket sock(socket(AF_UNIX, SOCK_STREAM, 0));
+        if (!sock.valid()
+            || bind(sock.d_fd, reinterpret_cast<sockaddr *>(&unixAddr), sizeof(unixAddr)) != 0
+            || ::listen(sock.d_fd, SOMAXCONN) != 0)
+            throw runtime_error("Could not listen on " + address + ": " + strerror(errno));
+        return sock;
+    }
+
+    addrinfo *info = resolve(address, true);
+    for (addrinfo *ai = info; ai; ai = ai->ai_next)
+    {
+        Socket sock(socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol));
+        if (!sock.valid())
+            continue;
+
+        int one = 1;
+        setsockopt(sock.d_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(sock.d_fd, ai->ai_addr, ai->ai_addrlen) == 0
+            && ::listen(sock.d_fd, SOMAXCONN) == 0)
+        {
+            freeaddrinfo(info);
+            return sock;
+        }
+    }
+    freeaddrinfo(info);
+    throw runtime_error("Could not listen on " + address + ": " + strerror(errno));
+}
+
+Socket Socket::connect(string const &address)
+{
+    sockaddr_un unixAddr;
+    if (isUnix(address, unixAddr))
+    {
+        Socket sock(socket(AF_UNIX, SOCK_STREAM, 0));
+        if (!sock.valid()
+            || ::connect(sock.d_fd, reinterpret_cast<sockaddr *>(&unixAddr), sizeof(unixAddr)) != 0)
+            throw runtime_error("Could not connect to " + address + ": " + strerror(errno));
+        return sock;
+    }
+
+    addrinfo *info = resolve(address, false);
+    for (addrinfo *ai = info; ai; ai = ai->ai_next)
+    {
+        Socket sock(socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol));
+        if (sock.valid() && ::connect(sock.d_fd, ai->ai_addr, ai->ai_addrlen) == 0)
+        {
+            freeaddrinfo(info);
+            noDelay(sock.d_fd);
+            return sock;
+        }
+    }
+    freeaddrinfo(info);
+    throw runtime_error("Could not connect to " + address + ": " + strerror(errno));
+}
+
+Socket Socket::accept()
+{
+    Socket sock(::accept(d_fd, nullptr, nullptr));
+    if (sock.valid())
+        noDelay(sock.d_fd);     // fails harmlessly for UNIX sockets
+    return sock;
+}
+
+bool Socket::valid() const
+{
+    return d_fd >= 0;
+}
+
+int Socket::fd() const
+{
+    return d_fd;
+}
+
+void Socket::close()
+{
+    if (d_fd >= 0)
+        ::close(d_fd);
+    d_fd = -1;
+}
+
+bool Socket::sendAll(void const *data, size_t size)
+{
+    char const *ptr = static_cast<char const *>(data);
+    while (size != 0)
+    {
+        ssize_t sent = send(d_fd, ptr, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return false;
+        ptr += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+bool Socket::receiveAll(void *data, size_t size)
+{
+    char *ptr = static_cast<char *>(data);
+    while (size != 0)
+    {
+        ssize_t received = recv(d_fd, ptr, size, 0);
+        if (received < 0 && errno == EINTR)
+            continue;
+        if (received <= 0)
+            return false;
+        ptr += received;
+        size -= received;
+    }
+    return true;
+}
@@ -0,0 +1,48 @@
+#ifndef SOCKET_H_
+#define SOCKET_H_
+
+#include <cstddef>
+#include <string>
+
+/**
+ * Stream socket (TCP or UNIX domain), closed when the object is destroyed.
+ * Addresses are "host:port" for TCP (an empty host listens on all
+ * interfaces) or "unix:/path/to/socket" for a UNIX domain socket.
+ * Movable, not copyable.
+ */
+class Socket
+{
+    int d_fd;
+
+    public:
+
+        Socket();
+        ~Socket();
+
+        Socket(Socket &&other);
+        Socket &operator=(Socket &&other);
+        Socket(Socket const &other) = delete;
+        Socket &operator=(Socket const &other) = delete;
+
+        // throw runtime_error when the address can not be used
+        static Socket listen(std::string const &address);
+        static Socket connect(std::string const &address);
+
+        // next connection of a listening socket, invalid on failure
+        Socket accept();
+
+        bool valid() const;
+        int fd() const;
+        void close();
+
+        // send or receive exactly size bytes, false if the connection
+        // failed or was closed
+        bool sendAll(void const *data, size_t size);
+        bool receiveAll(void *data, size_t size);
+
+    private:
+
+        explicit Socket(int fd);
+};
+
+#endif
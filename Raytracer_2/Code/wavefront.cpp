@@ -0,0 +1,354 @@
+#include "wavefront.h"
+
+#include "checkpoint.h"
+#include "hit.h"
+#include "image.h"
+#include "material.h"
+#include "scene.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+
+using namespace std;
+
+namespace
+{
+    unsigned const MORTON_BITS = 10;            // per axis
+
+    // spreads the lower 10 bits of v so there are two zero bits between
+    // every two bits
+    uint32_t spreadBits(uint32_t v)
+    {
+        v = (v | (v << 16)) & 0x030000FF;
+        v = (v | (v <<  8)) & 0x0300F00F;
+        v = (v | (v <<  4)) & 0x030C30C3;
+        v = (v | (v <<  2)) & 0x09249249;
+        return v;
+    }
+
+    // neighbouring rays with the same octant and coarse cell (top 4 bits
+    // per axis of the Morton code) count as coherent
+    bool coherent(uint32_t lhs, uint32_t rhs)
+    {
+        return (lhs >> 18) == (rhs >> 18);
+    }
+}
+
+Wavefront::Wavefront(Scene &scene, unsigned tileSize)
+:
+    d_scene(scene),
+    d_tileSize(tileSize)
+{}
+
+void Wavefront::render(Image &img, vector<Span> const &spans, Checkpoint *checkpoint)
+{
+    unsigned w = img.width();
+    unsigned h = img.height();
+    unsigned tilesX = (w + d_tileSize - 1) / d_tileSize;
+    unsigned tilesY = (h + d_tileSize - 1) / d_tileSize;
+
+    // cut the spans at the tile borders, tiles without pixels to render
+    // are skipped
+    vector<vector<Span>> tileSpans(tilesX * tilesY);
+    for (Span const &span : spans)
+    {
+        for (unsigned x0 = span.x0; x0 < span.x1; )
+        {
+            unsigned tileX = x0 / d_tileSize;
+            unsigned x1 = min(span.x1, (tileX + 1) * d_tileSize);
+            tileSpans[span.y / d_tileSize * tilesX + tileX].push_back(Span{span.y, x0, x1});
+            x0 = x1;
+        }
+    }
+
+    vector<unsigned> tiles;
+    for (unsigned tile = 0; tile != tileSpans.size(); ++tile)
+    {
+        if (!tileSpans[tile].empty())
+            tiles.push_back(tile);
+    }
+    int numTiles = tiles.size();
+
+    unsigned long long rays = 0;
+    unsigned long long shadowRays = 0;
+    unsigned long long bounces = 0;
+    unsigned long long sortedRays = 0;
+    unsigned long long coherentBefore = 0;
+    unsigned long long coherentAfter = 0;
+    unsigned long long tracedShadows = 0;
+    unsigned long long blocked = 0;
+    unsigned long long cacheHits = 0;
+
+    // tiles are independent, every thread renders its own tiles with its
+    // own queues and occluder cache
+    #pragma omp parallel reduction(+:rays, shadowRays, bounces, sortedRays, coherentBefore, \
+                                     coherentAfter, tracedShadows, blocked, cacheHits)
+    {
+        Scene::ShadowCache shadows(d_scene.lights.size());
+
+        #pragma omp for schedule(dynamic)
+        for (int idx = 0; idx < numTiles; ++idx)
+        {
+            unsigned tile = tiles[idx];
+            unsigned x0 = (tile % tilesX) * d_tileSize;
+            unsigned y0 = (tile / tilesX) * d_tileSize;
+            Statistics stats {0, 0, 0, 0, 0, 0};
+            renderTile(img, x0, y0, min(x0 + d_tileSize, w), min(y0 + d_tileSize, h),
+                       tileSpans[tile], stats, shadows);
+            // the whole tile at once: a resumed render has to trace the same
+            // rays together to get exactly the same sums
+            if (checkpoint)
+                checkpoint->complete(img, tileSpans[tile]);
+            rays += stats.rays;
+            shadowRays += stats.shadowRays;
+            bounces += stats.bounces;
+            sortedRays += stats.sortedRays;
+            coherentBefore += stats.coherentBefore;
+            coherentAfter += stats.coherentAfter;
+        }
+
+        tracedShadows += shadows.rays;
+        blocked += shadows.blocked;
+        cacheHits += shadows.hits;
+    }
+
+    cout << "Wavefront: " << rays << " rays, " << shadowRays << " shadow rays, "
+         << bounces << " bounces in " << numTiles << " tiles.\n";
+    if (sortedRays != 0)
+        cout << "Sorted " << sortedRays << " secondary rays, coherent neighbours "
+             << fixed << setprecision(1) << 100.0 * coherentBefore / sortedRays << "% -> "
+             << 100.0 * coherentAfter / sortedRays << "%.\n" << defaultfloat;
+    Scene::report(tracedShadows, blocked, cacheHits);
+}
+
+// --- Private -----------------------------------------------------------------
+
+void Wavefront::renderTile(Image &img, unsigned x0, unsigned y0, unsigned x1, unsigned y1,
+                           vector<Span> const &spans, Statistics &stats,
+                           Scene::ShadowCache &shadowCache)
+{
+    Scene &scene = d_scene;
+    unsigned h = img.height();
+    unsigned tileWidth = x1 - x0;
+    vector<Sampler::Offset> offsets;
+
+    // camera rays of all pixels and samples of the spans in the tile
+    vector<RayState> rays;
+    rays.reserve(tileWidth * (y1 - y0) * scene.sampler.count());
+    for (Span const &span : spans)
+    {
+        unsigned y = span.y;
+        for (unsigned x = span.x0; x != span.x1; ++x)
+        {
+            scene.sampler.offsets(x, y, offsets);
+            for (unsigned sample = 0; sample != offsets.size(); ++sample)
+            {
+                Point pixel(x + offsets[sample].a, h - 1 - y + offsets[sample].b, 0);
+                rays.push_back(RayState{Ray(scene.eye, (pixel - scene.eye).normalized()),
+                                        Random(x, y, sample), 1.0, scene.maxRecursionDepth,
+                                        (y - y0) * tileWidth + (x - x0)});
+            }
+        }
+    }
+
+    vector<Color> accum(tileWidth * (y1 - y0));
+    vector<HitState> hits;
+    vector<ShadowRay> shadows;
+    vector<RayState> next;
+
+    while (!rays.empty())
+    {
+        stats.rays += rays.size();
+        ++stats.bounces;
+
+        intersect(rays, hits);
+        shade(rays, hits, accum, shadows, next);
+
+        stats.shadowRays += shadows.size();
+        traceShadows(shadows, accum, shadowCache);
+
+        if (scene.sortRays)
+            sortRays(next, stats);
+
+        rays.swap(next);
+        next.clear();
+    }
+
+    for (Span const &span : spans)
+    {
+        unsigned y = span.y;
+        for (unsigned x = span.x0; x != span.x1; ++x)
+        {
+            //get the mean value for color over rays in a pixel
+            Color col = accum[(y - y0) * tileWidth + (x - x0)];
+            col /= scene.sampler.count();
+            col.clamp();
+            img(x, y) = col;
+        }
+    }
+}
+
+void Wavefront::intersect(vector<RayState> const &rays, vector<HitState> &hits) const
+{
+    hits.clear();
+    hits.reserve(rays.size());
+    for (unsigned ray = 0; ray != rays.size(); ++ray)
+    {
+        Hit hit(numeric_limits<double>::infinity(), Vector());
+        int idx = d_scene.accelerator.intersect(rays[ray].ray, hit);
+        // misses are dropped, the background adds nothing
+        if (idx < 0)
+            continue;
+        d_scene.mapTexture(*d_scene.objects[idx], hit);
+        hits.push_back(HitState{hit, static_cast<unsigned>(idx), ray});
+    }
+
+    // group the hits by object, so the same material is shaded in one go
+    sort(hits.begin(), hits.end(), [](HitState const &lhs, HitState const &rhs)
+    {
+        return lhs.object != rhs.object ? lhs.object < rhs.object : lhs.ray < rhs.ray;
+    });
+}
+
+void Wavefront::shade(vector<RayState> &rays, vector<HitState> const &hits,
+                      vector<Color> &accum, vector<ShadowRay> &shadows,
+                      vector<RayState> &next)
+{
+    Scene &scene = d_scene;
+
+    for (HitState const &state : hits)
+    {
+        RayState &ray = rays[state.ray];
+        ObjectPtr const &obj = scene.objects[state.object];
+        Material const &material = scene.materials[obj->material];
+        Point hit = ray.ray.at(state.hit.t);
+        Vector N = state.hit.N;
+        Vector V = -ray.ray.D;
+
+        Color color = scene.surfaceColor(material, state.hit);
+        accum[ray.pixel] += ray.weight * (color * material.ka);
+
+        // the light is added once its shadow ray turns out to be unblocked
+        auto addLight = [&](unsigned idx, double lightWeight)
+        {
+            Triple I_d;
+            Scene::Specular I_s(material.n, scene.fastMath);
+            scene.lightIntensity(*scene.lights[idx], hit, N, V, lightWeight, I_d, I_s);
+            Color lightColor = ray.weight * (I_d * material.kd * color
+                                             + I_s.sum() * material.ks);
+            if (scene.shadowOn)
+                shadows.push_back(ShadowRay{hit, lightColor, idx, state.object, ray.pixel,
+                                            Scene::shadowSeed(*scene.lights[idx], ray.rng)});
+            else
+                accum[ray.pixel] += lightColor;
+        };
+
+        // same choice of lights as Scene::shade
+        if (scene.lightSamples > 0) {
+            for (int i = 0; i < scene.lightSamples; i++) {
+                double pdf;
+                int idx = scene.lightTree.sample(hit, N, ray.rng.uniform(), pdf);
+                if (idx >= 0)
+                    addLight(idx, 1.0 / (pdf * scene.lightSamples));
+            }
+        } else {
+            scene.lightTree.forEachInFront(hit, N, [&](unsigned idx) {
+                addLight(idx, 1.0);
+            });
+        }
+
+        // the reflected ray continues in the next pass, same as Scene::trace
+        if (ray.depth <= 0 || material.ks <= 0.0)
+            continue;
+
+        double weight = ray.weight * material.ks;
+        if (weight < scene.reflectionThreshold) {
+            if (!scene.russianRoulette)
+                continue;
+
+            double survival = weight / scene.reflectionThreshold;
+            if (ray.rng.uniform() >= survival)
+                continue;
+            weight /= survival;
+        }
+
+        double s = N.dot(ray.ray.D)*2;
+        Triple R = ray.ray.D - (N*s);
+        R.normalize();
+        next.push_back(RayState{Ray(hit + 0.1 * R, R), ray.rng, weight, ray.depth - 1,
+                                ray.pixel});
+    }
+}
+
+void Wavefront::traceShadows(vector<ShadowRay> &shadows, vector<Color> &accum,
+                             Scene::ShadowCache &cache)
+{
+    // rays from the same light start at the same point, handle them together
+    sort(shadows.begin(), shadows.end(), [](ShadowRay const &lhs, ShadowRay const &rhs)
+    {
+        return lhs.light < rhs.light;
+    });
+
+    for (ShadowRay const &shadow : shadows)
+    {
+        double fraction = d_scene.shadowFraction(shadow.light, d_scene.objects[shadow.object],
+                                                 shadow.hit, shadow.seed, cache);
+        if (fraction > 0.0)
+            accum[shadow.pixel] += shadow.color * fraction;
+    }
+    shadows.clear();
+}
+
+void Wavefront::sortRays(vector<RayState> &rays, Statistics &stats) const
+{
+    if (rays.size() < 2)
+        return;
+
+    // origins are quantized on a grid over their bounding box
+    Point min = rays[0].ray.O;
+    Point max = rays[0].ray.O;
+    for (RayState const &state : rays)
+    {
+        for (unsigned axis = 0; axis != 3; ++axis)
+        {
+            min.data[axis] = std::min(min.data[axis], state.ray.O.data[axis]);
+            max.data[axis] = std::max(max.data[axis], state.ray.O.data[axis]);
+        }
+    }
+
+    // key: direction octant in the top 3 bits, Morton code of the cell
+    vector<pair<uint32_t, unsigned>> keys(rays.size());
+    double const cells = (1 << MORTON_BITS) - 1;
+    for (unsigned idx = 0; idx != rays.size(); ++idx)
+    {
+        Ray const &ray = rays[idx].ray;
+        uint32_t morton = 0;
+        uint32_t octant = 0;
+        for (unsigned axis = 0; axis != 3; ++axis)
+        {
+            double extent = max.data[axis] - min.data[axis];
+            double cell = extent > 0 ? (ray.O.data[axis] - min.data[axis]) / extent * cells : 0;
+            morton |= spreadBits(static_cast<uint32_t>(cell)) << (2 - axis);
+            octant |= (ray.D.data[axis] < 0 ? 1u : 0u) << axis;
+        }
+        keys[idx] = make_pair(octant << (3 * MORTON_BITS) | morton, idx);
+    }
+
+    for (unsigned idx = 1; idx != keys.size(); ++idx)
+        stats.coherentBefore += coherent(keys[idx - 1].first, keys[idx].first);
+
+    sort(keys.begin(), keys.end());
+
+    for (unsigned idx = 1; idx != keys.size(); ++idx)
+        stats.coherentAfter += coherent(keys[idx - 1].first, keys[idx].first);
+    stats.sortedRays += rays.size();
+
+    vector<RayState> sorted;
+    sorted.reserve(rays.size());
+    for (auto const &key : keys)
+        sorted.push_back(rays[key.second]);
+    rays.swap(sorted);
+}
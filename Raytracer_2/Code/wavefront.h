@@ -0,0 +1,101 @@
+#ifndef WAVEFRONT_H_
+#define WAVEFRONT_H_
+
+#include "hit.h"
+#include "random.h"
+#include "ray.h"
+#include "region.h"
+#include "scene.h"
+#include "triple.h"
+
+#include <vector>
+
+// Forward declerations
+class Checkpoint;
+class Image;
+
+/**
+ * Breadth first renderer. Instead of following every camera ray and its
+ * reflections to the end before starting the next one (Scene::trace), all
+ * rays of a tile are handled a bounce at a time: the whole queue is
+ * intersected, the hits are grouped by object and shaded together, and
+ * the shadow rays and reflected rays they produce are handled as the next
+ * batches. The image is the same as rendered depth first, only the order
+ * of the work differs.
+ *
+ * With "SortRays" the reflected rays of every pass are sorted by the
+ * octant of their direction and the Morton code of their origin, so rays
+ * that start close together in the same direction are traced together.
+ */
+class Wavefront
+{
+    // a ray in flight, with what is needed to continue its path
+    struct RayState
+    {
+        Ray ray;
+        Random rng;
+        double weight;          // fraction of its color that reaches the eye
+        int depth;              // reflections left
+        unsigned pixel;         // index in the tile
+    };
+
+    struct HitState
+    {
+        Hit hit;
+        unsigned object;        // index in Scene::objects
+        unsigned ray;           // index in the ray queue
+    };
+
+    // shadow ray from a light to a shaded point, adds color if not blocked
+    struct ShadowRay
+    {
+        Point hit;
+        Color color;            // weighted diffuse and specular light
+        unsigned light;
+        unsigned object;
+        unsigned pixel;
+        uint32_t seed;          // of the points on area lights
+    };
+
+    Scene &d_scene;
+    unsigned d_tileSize;
+
+    public:
+
+        // counts of the rays handled, reported after rendering
+        struct Statistics
+        {
+            unsigned long long rays;
+            unsigned long long shadowRays;
+            unsigned long long bounces;     // number of queue passes
+            unsigned long long sortedRays;  // secondary rays sorted
+            unsigned long long coherentBefore;  // neighbours in the same
+            unsigned long long coherentAfter;   // octant and cell
+        };
+
+        explicit Wavefront(Scene &scene, unsigned tileSize = 32);
+
+        // renders the pixels of the spans, finished tiles are reported to
+        // the checkpoint (if any)
+        void render(Image &img, std::vector<Span> const &spans, Checkpoint *checkpoint);
+
+    private:
+
+        void renderTile(Image &img, unsigned x0, unsigned y0, unsigned x1, unsigned y1,
+                        std::vector<Span> const &spans, Statistics &stats,
+                        Scene::ShadowCache &shadowCache);
+
+        void intersect(std::vector<RayState> const &rays, std::vector<HitState> &hits) const;
+
+        void shade(std::vector<RayState> &rays, std::vector<HitState> const &hits,
+                   std::vector<Color> &accum, std::vector<ShadowRay> &shadows,
+                   std::vector<RayState> &next);
+
+        // sorted by light, so the occluder cache of a light is used in a row
+        void traceShadows(std::vector<ShadowRay> &shadows, std::vector<Color> &accum,
+                          Scene::ShadowCache &cache);
+
+        void sortRays(std::vector<RayState> &rays, Statistics &stats) const;
+};
+
+#endif